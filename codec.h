@@ -1,12 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <bit>
 #include <cassert>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
 #include <limits>
+#include <memory>
+#include <ranges>
+#include <span>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+#if defined(__BMI2__)
+#    include <immintrin.h>
+#endif
 
 #include <kun.h>
 
@@ -15,28 +29,216 @@ namespace kun {
 static_assert(sizeof(float) == 4, "");
 static_assert(sizeof(double) == 8, "");
 
-class Encoder
+// Allocator whose value construction leaves trivial types uninitialized, so growing a buffer with resize() does
+// not zero-fill bytes the encoder is about to overwrite.
+template <typename T, typename Alloc = std::allocator<T>>
+class DefaultInitAllocator : public Alloc
+{
+    using Traits = std::allocator_traits<Alloc>;
+
+public:
+    template <typename U>
+    struct rebind
+    {
+        using other = DefaultInitAllocator<U, typename Traits::template rebind_alloc<U>>;
+    };
+
+    using Alloc::Alloc;
+
+    template <typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible_v<U>)
+    {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        Traits::construct(static_cast<Alloc&>(*this), p, std::forward<Args>(args)...);
+    }
+};
+
+using Buffer = std::vector<uint8_t, DefaultInitAllocator<uint8_t>>;
+
+// Destination of a streaming encode. Write receives the encoded bytes in order, in pieces of at most the encoder
+// buffer size unless a single payload is larger, and returns false to abort the encode.
+template <typename T>
+concept OutputSink = requires(T& sink, const uint8_t* data, size_t size) {
+    { sink.Write(data, size) } -> std::convertible_to<bool>;
+};
+
+// Sink that can take a reference to a string/bytes payload instead of a copy. Payloads of at least Threshold()
+// bytes are passed to Reference and must stay alive, unmodified, for as long as the sink output is used.
+template <typename T>
+concept ReferenceSink = OutputSink<T> && requires(T& sink, const uint8_t* data, size_t size) {
+    { sink.Reference(data, size) } -> std::convertible_to<bool>;
+    { sink.Threshold() } -> std::convertible_to<size_t>;
+};
+
+// Runs task(0) .. task(count - 1), in any order and on any threads, and returns when they all have, see
+// ThreadExecutor.
+template <typename E>
+concept Executor = requires(E& executor, size_t count, const std::function<void(size_t)>& task) {
+    executor(count, task);
+};
+
+// ByteSize() with the elements of the repeated message fields sized by executor, in chunks of
+// ParallelSizes::kChunk elements. Fills the same cached sizes as ByteSize(), see Encoder::EncodeParallel().
+template <typename T, Executor E>
+    requires(is_message_v<T>)
+size_t ByteSizeParallel(const T& value, E&& executor)
+{
+    // the first pass collects the chunks
+    ParallelSizes sizes;
+    value.ByteSize(&sizes);
+
+    auto task = [&](size_t i) {
+        auto& chunk = sizes.chunks[i];
+        chunk.result = chunk.size(chunk.container, chunk.begin, chunk.end);
+    };
+    if (sizes.chunks.size() == 1) {
+        task(0);
+    } else if (!sizes.chunks.empty()) {
+        executor(sizes.chunks.size(), std::function<void(size_t)>(task));
+    }
+
+    sizes.collected = true;
+    return value.ByteSize(&sizes);
+}
+
+// With Sink = void the encoder writes a message into one contiguous buffer sized by ByteSize(). With an
+// OutputSink it encodes through a fixed-size buffer that is flushed to the sink whenever it fills up, so peak
+// memory stays constant however large the message is.
+template <typename Sink = void>
+    requires(std::is_void_v<Sink> || OutputSink<Sink>)
+class BasicEncoder
 {
+    static constexpr bool streaming = !std::is_void_v<Sink>;
 
 public:
-    Encoder()
+    static constexpr size_t kStreamBufferSize = 64 * 1024;
+
+    BasicEncoder()
       : data_()
-      , ptr_(reinterpret_cast<uint8_t*>(data_.data()))
+      , ptr_(nullptr)
+      , end_(nullptr)
+      , sink_(nullptr)
+      , ok_(true)
+      , chunks_(nullptr)
     {
     }
 
-    Encoder(const Encoder&) = delete;
+    BasicEncoder(const BasicEncoder&) = delete;
+
+    BasicEncoder& operator=(const BasicEncoder&) = delete;
+
+    // Streams the encoding of value to sink. Returns false if the sink rejected a write.
+    template <typename T, typename S>
+        requires(is_message_v<T> && std::is_same_v<S, Sink>)
+    bool Encode(const T& value, S& sink)
+    {
+        // fills the cached sizes used for length prefixes
+        value.ByteSize();
+
+        if (data_.size() != kStreamBufferSize) {
+            data_.resize_and_overwrite(kStreamBufferSize, [](char*, size_t) { return kStreamBufferSize; });
+        }
+        sink_ = &sink;
+        ok_ = true;
+        ptr_ = reinterpret_cast<uint8_t*>(data_.data());
+        end_ = ptr_ + data_.size();
+
+        value.Encode(*this);
+        Flush();
 
-    Encoder& operator=(const Encoder&) = delete;
+        sink_ = nullptr;
+        return ok_;
+    }
 
+    // Encodes into the encoder-owned buffer, replacing its previous content. The buffer keeps its capacity, so a
+    // reused Encoder stops allocating once it has seen its largest message.
     template <typename T>
-        requires(is_message_v<T>)
+        requires(is_message_v<T> && !streaming)
     ALWAYS_INLINE void Encode(const T& value)
+    {
+        data_.clear();
+        Encode(value, data_);
+    }
+
+    // Encodes into the encoder-owned buffer like Encode(value), byte for byte, with the work spread over executor.
+    // The sizes come from ByteSizeParallel(), then the elements of the repeated message fields are left out of the
+    // sequential pass, which only moves past their bytes, and are encoded in place by the tasks.
+    template <typename T, Executor E>
+        requires(is_message_v<T> && !streaming)
+    void EncodeParallel(const T& value, E&& executor)
+    {
+        auto size = ByteSizeParallel(value, executor);
+        data_.clear();
+        data_.resize_and_overwrite(size, [&](char* data, size_t) {
+            std::vector<Chunk> chunks;
+            chunks_ = &chunks;
+            ptr_ = reinterpret_cast<uint8_t*>(data);
+            value.Encode(*this);
+            chunks_ = nullptr;
+            assert(ptr_ == reinterpret_cast<uint8_t*>(data) + size);
+
+            auto task = [&](size_t i) {
+                auto& chunk = chunks[i];
+                chunk.encode(chunk.container, chunk.begin, chunk.end, chunk.out);
+            };
+            if (chunks.size() == 1) {
+                task(0);
+            } else if (!chunks.empty()) {
+                executor(chunks.size(), std::function<void(size_t)>(task));
+            }
+            return size;
+        });
+    }
+
+    // Appends the encoding of value to out without zero-filling the grown part.
+    template <typename T>
+        requires(is_message_v<T> && !streaming)
+    ALWAYS_INLINE void Encode(const T& value, std::string& out)
     {
         auto size = value.ByteSize();
-        EnsureSpace(size);
+        auto offset = out.size();
+        out.resize_and_overwrite(offset + size, [&](char* data, size_t) {
+            ptr_ = reinterpret_cast<uint8_t*>(data) + offset;
+            value.Encode(*this);
+            assert(ptr_ == reinterpret_cast<uint8_t*>(data) + offset + size);
+            return offset + size;
+        });
+    }
+
+    // Appends the encoding of value to out. The grown part is only left uninitialized when the allocator
+    // default-initializes, as kun::Buffer does; std::allocator still zero-fills.
+    template <typename T, typename Alloc>
+        requires(is_message_v<T> && !streaming)
+    ALWAYS_INLINE void Encode(const T& value, std::vector<uint8_t, Alloc>& out)
+    {
+        auto size = value.ByteSize();
+        auto offset = out.size();
+        out.resize(offset + size);
+        ptr_ = out.data() + offset;
+        value.Encode(*this);
+        assert(ptr_ == out.data() + out.size());
+    }
+
+    // Encodes into a caller-provided buffer. Returns false and the required size if out is too small, otherwise
+    // true and the number of bytes written.
+    template <typename T>
+        requires(is_message_v<T> && !streaming)
+    ALWAYS_INLINE std::tuple<bool, size_t> Encode(const T& value, std::span<uint8_t> out)
+    {
+        auto size = value.ByteSize();
+        if (size > out.size()) {
+            return { false, size };
+        }
+
+        ptr_ = out.data();
         value.Encode(*this);
-        assert(size == ptr_ - reinterpret_cast<uint8_t*>(data_.data()));
+        assert(ptr_ == out.data() + size);
+        return { true, size };
     }
 
     template <typename Msg, int index, typename T>
@@ -69,12 +271,12 @@ public:
             uint64_t size = value.size();
 
             EncodeLengthDelim(meta.tag, size);
-            EncodeRaw(value.data(), size);
+            EncodeBytes(value.data(), size);
             return;
         } else if constexpr (is_message_v<T>) {
             auto size = value._cached_size_;
             EncodeLengthDelim(meta.tag, size);
-            value.Encode(*this);
+            EncodeMessage(value);
             return;
         } else if constexpr (is_repeated<T>::value) {
             using EntryType = typename T::value_type;
@@ -98,41 +300,42 @@ public:
                 } else {
                     size_t size = cachedSize;
                     EncodeLengthDelim(meta.tag, size);
-
-                    for (auto v : value) {
-                        EncodeVarint(Encoding<meta.encoding>::Encode(v));
-                    }
+                    EncodePackedVarint<meta.encoding>(value.data(), value.size());
                 }
                 return;
             } else if constexpr (is_enum_v<EntryType>) {
                 size_t size = cachedSize;
 
                 EncodeLengthDelim(meta.tag, size);
-                for (auto v : value) {
-                    EncodeVarint(Encoding<meta.encoding>::Encode(v));
-                }
+                EncodePackedVarint<meta.encoding>(value.data(), value.size());
                 return;
             } else if constexpr (is_string_v<EntryType>) {
                 for (auto& entry : value) {
                     uint64_t size = entry.size();
 
                     EncodeLengthDelim(meta.tag, size);
-                    EncodeRaw(entry.data(), size);
+                    EncodeBytes(entry.data(), size);
                 }
                 return;
             } else if constexpr (is_message_v<EntryType>) {
+                if constexpr (!streaming) {
+                    if (chunks_ != nullptr) [[unlikely]] {
+                        EncodeLater<meta.tag>(value);
+                        return;
+                    }
+                }
                 for (auto& entry : value) {
                     auto size = entry._cached_size_;
 
                     EncodeLengthDelim(meta.tag, size);
-                    entry.Encode(*this);
+                    EncodeMessage(entry);
                 }
                 return;
             }
         } else if constexpr (is_map_v<T>) {
             using KeyType = typename T::key_type;
             using ValueType = typename T::mapped_type;
-            for (auto& entry : value) {
+            for (const auto& entry : value) {
                 ConstMapEntry<KeyType, ValueType, meta.encoding> e{ entry };
                 auto size = e.ByteSize();
                 EncodeLengthDelim(meta.tag, size);
@@ -143,13 +346,60 @@ public:
         std::unreachable();
     }
 
-    ALWAYS_INLINE std::string& Str() { return data_; }
+    // Unknown fields are written back as they were decoded.
+    template <typename T>
+        requires(is_unknown_fields_v<T>)
+    ALWAYS_INLINE void EncodeUnknown(const T& value)
+    {
+        for (auto range : value.Ranges()) {
+            EncodeBytes(range.data(), range.size());
+        }
+    }
+
+    ALWAYS_INLINE std::string& Str()
+        requires(!streaming)
+    {
+        return data_;
+    }
+
+    // Drops the encoded content but keeps the buffer capacity for the next message.
+    ALWAYS_INLINE void Reset() { data_.clear(); }
 
 private:
-    ALWAYS_INLINE void EnsureSpace(size_t size)
+    // elements of a repeated message field that EncodeParallel() encodes at out
+    struct Chunk
     {
-        data_.resize(size);
-        ptr_ = reinterpret_cast<uint8_t*>(data_.data());
+        const void* container;
+        size_t begin;
+        size_t end;
+        uint8_t* out;
+        void (*encode)(const void* container, size_t begin, size_t end, uint8_t* out);
+    };
+
+    // Leaves room for the elements of value and records them in chunks for EncodeParallel().
+    template <uint64_t tag, typename T>
+    void EncodeLater(const T& value)
+    {
+        for (size_t i = 0; i < value.size(); i += ParallelSizes::kChunk) {
+            auto end = std::min(i + ParallelSizes::kChunk, value.size());
+            chunks_->push_back({ &value, i, end, ptr_, &EncodeChunk<tag, T> });
+            for (auto j = i; j < end; j++) {
+                auto size = value[j]._cached_size_;
+                ptr_ += TagSize(tag) + LengthDelimitedSize(size);
+            }
+        }
+    }
+
+    template <uint64_t tag, typename T>
+    static void EncodeChunk(const void* container, size_t begin, size_t end, uint8_t* out)
+    {
+        auto& value = *static_cast<const T*>(container);
+        BasicEncoder enc;
+        enc.ptr_ = out;
+        for (auto i = begin; i < end; i++) {
+            enc.EncodeLengthDelim(tag, value[i]._cached_size_);
+            enc.EncodeMessage(value[i]);
+        }
     }
 
     ALWAYS_INLINE void EncodeTag(uint64_t tag) { EncodeVarint(tag); }
@@ -164,6 +414,7 @@ private:
         requires(std::is_unsigned_v<T>)
     ALWAYS_INLINE void EncodeVarint(T value)
     {
+        Reserve(10);
         while (value >= 0x80) [[unlikely]] {
             *ptr_++ = static_cast<uint8_t>(value | 0x80);
             value >>= 7;
@@ -171,234 +422,1013 @@ private:
         *ptr_++ = static_cast<uint8_t>(value);
     }
 
+    template <uint32_t encoding, typename T>
+    ALWAYS_INLINE void EncodePackedVarint(const T* data, size_t size)
+    {
+        constexpr auto mode = PackedVarintMode<encoding, T>();
+        auto src = reinterpret_cast<const PackedType<T>*>(data);
+        if constexpr (streaming) {
+            while (size > 0) {
+                auto n = std::min(size, kStreamBufferSize / 10);
+                Reserve(n * 10);
+                ptr_ = simd::EncodePackedVarint<mode>(ptr_, src, n);
+                src += n;
+                size -= n;
+            }
+        } else {
+            ptr_ = simd::EncodePackedVarint<mode>(ptr_, src, size);
+        }
+    }
+
     template <typename T>
     ALWAYS_INLINE void EncodeRaw(const T* src, size_t size)
     {
         if constexpr ((sizeof(T) != 1) && std::endian::native == std::endian::big) {
             for (auto end = src + size; src < end; src++) {
+                Reserve(sizeof(T));
                 T v = std::byteswap(*src);
                 std::memcpy(ptr_, &v, sizeof(T));
                 ptr_ += sizeof(T);
             }
         } else {
+            if constexpr (streaming) {
+                if (size * sizeof(T) > static_cast<size_t>(end_ - ptr_)) [[unlikely]] {
+                    EncodeLarge(reinterpret_cast<const uint8_t*>(src), size * sizeof(T));
+                    return;
+                }
+            }
             std::memcpy(ptr_, src, size * sizeof(T));
             ptr_ += size * sizeof(T);
         }
     }
 
-private:
-    std::string data_;
-    uint8_t* ptr_;
-};
-
-class Decoder
-{
-public:
-    Decoder()
-      : ptr_(nullptr)
-      , end_(nullptr)
+    template <typename T>
+    ALWAYS_INLINE void EncodeMessage(const T& value)
     {
+        if constexpr (is_lazy_v<T>) {
+            if (!value.Parsed()) {
+                EncodeBytes(value.Raw().data(), value.Raw().size());
+            } else {
+                value->Encode(*this);
+            }
+        } else {
+            value.Encode(*this);
+        }
     }
 
-    Decoder(const std::string& str)
-      : ptr_(reinterpret_cast<const uint8_t*>(str.data()))
-      , end_(reinterpret_cast<const uint8_t*>(str.data()) + str.size())
+    ALWAYS_INLINE void EncodeBytes(const char* src, size_t size)
     {
+        if constexpr (ReferenceSink<Sink>) {
+            if (size >= sink_->Threshold()) {
+                Flush();
+                ok_ = ok_ && sink_->Reference(reinterpret_cast<const uint8_t*>(src), size);
+                return;
+            }
+        }
+        EncodeRaw(src, size);
     }
 
-    Decoder(const uint8_t* beg, uint64_t size)
-      : ptr_(beg)
-      , end_(beg + size)
+    // Makes room for size bytes in the stream buffer. The contiguous mode sizes its buffer up front.
+    ALWAYS_INLINE void Reserve(size_t size)
     {
+        if constexpr (streaming) {
+            if (static_cast<size_t>(end_ - ptr_) < size) [[unlikely]] {
+                Flush();
+            }
+        }
     }
 
-    Decoder(const uint8_t* beg, const uint8_t* end)
-      : ptr_(beg)
-      , end_(end)
+    void EncodeLarge(const uint8_t* src, size_t size)
     {
+        Flush();
+        if (size > static_cast<size_t>(end_ - ptr_)) {
+            ok_ = ok_ && sink_->Write(src, size);
+            return;
+        }
+        std::memcpy(ptr_, src, size);
+        ptr_ += size;
     }
 
-    template <typename T>
-        requires(is_message_v<T>)
-    ALWAYS_INLINE bool Decode(T& value)
+    void Flush()
     {
-        while (ptr_ < end_) {
-            auto [ok, tag] = DecodeVarint();
+        auto begin = reinterpret_cast<uint8_t*>(data_.data());
+        if (ptr_ != begin) {
+            ok_ = ok_ && sink_->Write(begin, ptr_ - begin);
+            ptr_ = begin;
+        }
+    }
 
-            if (!ok) {
-                return false;
-            }
+private:
+    std::string data_;
+    uint8_t* ptr_;
+    uint8_t* end_;
+    Sink* sink_;
+    bool ok_;
+    // set by EncodeParallel()
+    std::vector<Chunk>* chunks_;
+};
 
-            switch (tag & 0x07) {
-            case WIRE_VARINT: {
-                auto [ok, v] = DecodeVarint();
-                if (!ok) {
-                    return false;
-                }
+using Encoder = BasicEncoder<>;
 
-                Decoder d{ reinterpret_cast<uint8_t*>(&v), sizeof(v) };
-                if (!value.Decode(d, tag)) {
-                    return false;
-                }
-            } break;
-            case WIRE_FIXED32: {
-                if (Size() < 4) {
-                    return false;
-                }
+// Encodes a message from the end of its buffer toward the front, children before parents, so every length prefix
+// is known by the time it is written. No ByteSize() pass is needed and the cached size members are never touched.
+// Fields come out in the same order as with Encoder; only map entries may be ordered differently.
+class ReverseEncoder
+{
+public:
+    ReverseEncoder()
+      : data_()
+      , begin_(nullptr)
+      , ptr_(nullptr)
+      , end_(nullptr)
+    {
+    }
 
-                Decoder d{ ptr_, 4 };
-                if (!value.Decode(d, tag)) {
-                    return false;
-                }
-                ptr_ += 4;
-            } break;
-            case WIRE_FIXED64: {
-                if (Size() < 8) {
-                    return false;
-                }
+    ReverseEncoder(const ReverseEncoder&) = delete;
 
-                Decoder d{ ptr_, 8 };
-                if (!value.Decode(d, tag)) {
-                    return false;
-                }
-                ptr_ += 8;
-            } break;
-            case WIRE_LENGTH_DELIM: {
-                auto [ok, length] = DecodeLength();
-                if (!ok) {
-                    return false;
-                }
+    ReverseEncoder& operator=(const ReverseEncoder&) = delete;
 
-                Decoder d{ ptr_, length };
-                if (!value.Decode(d, tag)) {
-                    return false;
-                }
-                ptr_ += length;
-            } break;
-            default:
-                return false;
-            }
-        }
-        return ptr_ == end_;
+    // Replaces the previous content; the buffer keeps its capacity.
+    template <typename T>
+        requires(is_message_v<T>)
+    ALWAYS_INLINE std::string_view Encode(const T& value)
+    {
+        ptr_ = end_;
+        value.EncodeReverse(*this);
+        return View();
     }
 
     template <typename Msg, int index, typename T>
-    ALWAYS_INLINE bool Decode(T& value)
+    ALWAYS_INLINE void Encode(const T& value)
     {
         constexpr auto meta = Msg::__meta__[index];
         if constexpr (is_boolean_v<T>) {
-            value = (*reinterpret_cast<const uint64_t*>(ptr_) != 0);
-            return true;
+            uint8_t v = value ? 1 : 0;
+            EncodeRaw(&v, 1);
+            EncodeTag(meta.tag);
+            return;
         } else if constexpr (is_integral_v<T>) {
             if constexpr (meta.encoding == ENCODING_FIXED) {
-                if (!DecodeRaw(value)) {
-                    return false;
-                }
-                return Empty();
-            }
-            uint64_t v = Encoding<meta.encoding>::Decode(*reinterpret_cast<const uint64_t*>(ptr_));
-
-            if (!Convert(v, value)) {
-                return false;
+                EncodeRaw(&value, 1);
+            } else {
+                EncodeVarint(Encoding<meta.encoding>::Encode(value));
             }
-            return true;
+            EncodeTag(meta.tag);
+            return;
         } else if constexpr (is_enum_v<T>) {
-            int32_t v;
-            if (!Convert(*reinterpret_cast<const uint64_t*>(ptr_), v)) {
-                return false;
-            }
-
-            value = static_cast<T>(v);
-            return true;
+            EncodeVarint(Encoding<meta.encoding>::Encode(value));
+            EncodeTag(meta.tag);
+            return;
         } else if constexpr (is_floating_point_v<T>) {
-            if (!DecodeRaw(value)) {
-                return false;
-            }
-            return Empty();
+            EncodeRaw(&value, 1);
+            EncodeTag(meta.tag);
+            return;
         } else if constexpr (is_string_v<T>) {
-            value = std::string{ reinterpret_cast<const char*>(ptr_), reinterpret_cast<const char*>(end_) };
-            return true;
+            EncodeRaw(value.data(), value.size());
+            EncodeLengthDelim(meta.tag, value.size());
+            return;
+        } else if constexpr (is_message_v<T>) {
+            auto mark = Written();
+            if constexpr (is_lazy_v<T>) {
+                if (!value.Parsed()) {
+                    EncodeRaw(value.Raw().data(), value.Raw().size());
+                } else {
+                    value->EncodeReverse(*this);
+                }
+            } else {
+                value.EncodeReverse(*this);
+            }
+            EncodeLengthDelim(meta.tag, Written() - mark);
+            return;
         } else if constexpr (is_repeated<T>::value) {
             using EntryType = typename T::value_type;
             if constexpr (is_boolean_v<EntryType>) {
-                value.resize(end_ - ptr_);
+                Reserve(value.size());
+                ptr_ -= value.size();
                 for (size_t i = 0; i < value.size(); i++) {
-                    value[i] = (*(ptr_ + i) != 0);
+                    ptr_[i] = value[i] ? 1 : 0;
                 }
-                return true;
-            } else if constexpr (is_floating_point_v<EntryType>) {
-                if (!DecodeRaw(value)) {
-                    return false;
+                EncodeLengthDelim(meta.tag, value.size());
+                return;
+            } else if constexpr (is_floating_point_v<EntryType> ||
+                                 (is_integral_v<EntryType> && meta.encoding == ENCODING_FIXED)) {
+                EncodeRaw(value.data(), value.size());
+                EncodeLengthDelim(meta.tag, sizeof(EntryType) * value.size());
+                return;
+            } else if constexpr (is_integral_v<EntryType> || is_enum_v<EntryType>) {
+                auto mark = Written();
+                for (auto it = value.rbegin(); it != value.rend(); ++it) {
+                    EncodeVarint(Encoding<meta.encoding>::Encode(*it));
                 }
-
-                return true;
-            } else if constexpr (is_integral_v<EntryType>) {
-                if constexpr (meta.encoding == ENCODING_FIXED) {
-                    if (!DecodeRaw(value)) {
-                        return false;
-                    }
-
-                    return true;
+                EncodeLengthDelim(meta.tag, Written() - mark);
+                return;
+            } else if constexpr (is_string_v<EntryType> || is_message_v<EntryType>) {
+                for (auto it = value.rbegin(); it != value.rend(); ++it) {
+                    Encode<Msg, index>(*it);
+                }
+                return;
+            }
+        } else if constexpr (is_map_v<T>) {
+            using KeyType = typename T::key_type;
+            using ValueType = typename T::mapped_type;
+            // backwards if the map has an order, so the output is the same as the forward encoder's
+            if constexpr (std::ranges::bidirectional_range<T>) {
+                for (auto it = value.rbegin(); it != value.rend(); ++it) {
+                    Encode<Msg, index>(ConstMapEntry<KeyType, ValueType, meta.encoding>{ *it });
+                }
+            } else {
+                for (const auto& entry : value) {
+                    Encode<Msg, index>(ConstMapEntry<KeyType, ValueType, meta.encoding>{ entry });
+                }
+            }
+            return;
+        }
+        std::unreachable();
+    }
+
+    template <typename T>
+        requires(is_unknown_fields_v<T>)
+    ALWAYS_INLINE void EncodeUnknown(const T& value)
+    {
+        auto ranges = value.Ranges();
+        for (auto it = ranges.rbegin(); it != ranges.rend(); ++it) {
+            EncodeRaw(it->data(), it->size());
+        }
+    }
+
+    ALWAYS_INLINE std::string_view View() const { return { reinterpret_cast<const char*>(ptr_), Written() }; }
+
+private:
+    ALWAYS_INLINE size_t Written() const { return end_ - ptr_; }
+
+    ALWAYS_INLINE void EncodeTag(uint64_t tag) { EncodeVarint(tag); }
+
+    ALWAYS_INLINE void EncodeLengthDelim(uint64_t tag, uint64_t size)
+    {
+        EncodeVarint(size);
+        EncodeVarint(tag);
+    }
+
+    template <typename T>
+        requires(std::is_unsigned_v<T>)
+    ALWAYS_INLINE void EncodeVarint(T value)
+    {
+        Reserve(10);
+        ptr_ -= Encoding<>::EncodedSize(value);
+        auto p = ptr_;
+        while (value >= 0x80) {
+            *p++ = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        *p = static_cast<uint8_t>(value);
+    }
+
+    template <typename T>
+    ALWAYS_INLINE void EncodeRaw(const T* src, size_t size)
+    {
+        Reserve(size * sizeof(T));
+        ptr_ -= size * sizeof(T);
+        if constexpr ((sizeof(T) != 1) && std::endian::native == std::endian::big) {
+            for (size_t i = 0; i < size; i++) {
+                T v = std::byteswap(src[i]);
+                std::memcpy(ptr_ + i * sizeof(T), &v, sizeof(T));
+            }
+        } else {
+            std::memcpy(ptr_, src, size * sizeof(T));
+        }
+    }
+
+    ALWAYS_INLINE void Reserve(size_t size)
+    {
+        if (static_cast<size_t>(ptr_ - begin_) < size) [[unlikely]] {
+            Grow(size);
+        }
+    }
+
+    // Moves the written tail to the end of a larger buffer.
+    void Grow(size_t size)
+    {
+        auto written = Written();
+        auto capacity = std::max({ data_.size() * 2, written + size, size_t(256) });
+
+        std::string data;
+        data.resize_and_overwrite(capacity, [&](char* p, size_t) {
+            if (written > 0) {
+                std::memcpy(p + capacity - written, ptr_, written);
+            }
+            return capacity;
+        });
+        data_.swap(data);
+
+        begin_ = reinterpret_cast<uint8_t*>(data_.data());
+        end_ = begin_ + data_.size();
+        ptr_ = end_ - written;
+    }
+
+    std::string data_;
+    uint8_t* begin_;
+    uint8_t* ptr_;
+    uint8_t* end_;
+};
+
+// Index of the field called name in message T, for FieldMask and Fields. T::__meta__.size() if there is none.
+template <typename T>
+    requires(is_message_v<T>)
+inline constexpr uint32_t IndexOf(std::string_view name)
+{
+    auto it = std::ranges::find(T::__meta__, name, &FieldMeta::name);
+    return it - T::__meta__.begin();
+}
+
+// Fields to decode, by index, see Decoder::Decode(T&, const Mask&). A field can carry a mask of its own that is
+// applied to the sub-message, or to every element of a repeated sub-message.
+class FieldMask
+{
+public:
+    FieldMask() = default;
+
+    FieldMask(std::initializer_list<uint32_t> indices)
+    {
+        for (auto index : indices) {
+            Add(index);
+        }
+    }
+
+    FieldMask& Add(uint32_t index)
+    {
+        if (bits_.size() <= index / 64) {
+            bits_.resize(index / 64 + 1);
+        }
+        bits_[index / 64] |= uint64_t(1) << (index % 64);
+        return *this;
+    }
+
+    FieldMask& Add(uint32_t index, FieldMask nested)
+    {
+        Add(index);
+        nested_.emplace_back(index, std::move(nested));
+        return *this;
+    }
+
+    bool Has(uint32_t index) const { return index / 64 < bits_.size() && (bits_[index / 64] >> (index % 64) & 1); }
+
+    // nullptr if the whole sub-message is decoded
+    const FieldMask* Nested(uint32_t index) const
+    {
+        for (auto& [i, mask] : nested_) {
+            if (i == index) {
+                return &mask;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    std::vector<uint64_t> bits_;
+    std::vector<std::pair<uint32_t, FieldMask>> nested_;
+};
+
+// A FieldMask fixed at compile time, without nested masks.
+template <uint32_t... indices>
+struct Fields
+{
+    static constexpr bool Has(uint32_t index) { return ((index == indices) || ...); }
+};
+
+template <typename T>
+    requires(is_message_v<T>)
+class StreamDecoder;
+
+// An element of a repeated message field whose decoding Decoder::DecodeParallel() put off.
+struct ParallelJob
+{
+    void* container;
+    size_t index;
+    const uint8_t* begin;
+    const uint8_t* end;
+    bool (*decode)(void* container, size_t index, const uint8_t* begin, const uint8_t* end);
+};
+
+class Decoder
+{
+public:
+    Decoder()
+      : ptr_(nullptr)
+      , end_(nullptr)
+      , mask_(nullptr)
+      , jobs_(nullptr)
+      , defer_(nullptr)
+      , stream_(nullptr)
+    {
+    }
+
+    Decoder(const std::string& str)
+      : ptr_(reinterpret_cast<const uint8_t*>(str.data()))
+      , end_(reinterpret_cast<const uint8_t*>(str.data()) + str.size())
+      , mask_(nullptr)
+      , jobs_(nullptr)
+      , defer_(nullptr)
+      , stream_(nullptr)
+    {
+    }
+
+    Decoder(const uint8_t* beg, uint64_t size)
+      : ptr_(beg)
+      , end_(beg + size)
+      , mask_(nullptr)
+      , jobs_(nullptr)
+      , defer_(nullptr)
+      , stream_(nullptr)
+    {
+    }
+
+    Decoder(const uint8_t* beg, const uint8_t* end)
+      : ptr_(beg)
+      , end_(end)
+      , mask_(nullptr)
+      , jobs_(nullptr)
+      , defer_(nullptr)
+      , stream_(nullptr)
+    {
+    }
+
+    // Merges the message into value, like protobuf's MergeFromString: scalars are overwritten, repeated fields and
+    // maps are appended to, and sub-messages that are already set are merged into. Decode into a default-constructed
+    // message, or see DecodeReuse().
+    template <typename T>
+        requires(is_message_v<T>)
+    ALWAYS_INLINE bool Decode(T& value)
+    {
+        if (stream_ != nullptr) [[unlikely]] {
+            return Enter(value);
+        }
+        return Built(value, DecodeMessage(value));
+    }
+
+    // Decodes like Decode(T&), but the elements of the repeated message fields of value are decoded by executor,
+    // in up to 64 tasks of about the same number of bytes. value is scanned first, in order, so it ends up the same
+    // as with Decode(). Only the fields of value itself are split, an element is decoded by one task with all it
+    // holds. Not for messages generated with alloc=arena, unless the memory resource is synchronized.
+    template <typename T, Executor E>
+        requires(is_message_v<T>)
+    bool DecodeParallel(T& value, E&& executor)
+    {
+        std::vector<ParallelJob> jobs;
+        jobs_ = &jobs;
+        bool ok = Decode(value);
+        jobs_ = nullptr;
+        if (!ok || jobs.empty()) {
+            return ok;
+        }
+
+        // task i decodes the jobs from starts[i] to starts[i + 1]
+        size_t bytes = 0;
+        for (auto& job : jobs) {
+            bytes += job.end - job.begin;
+        }
+        size_t tasks = std::min<size_t>(jobs.size(), 64);
+        std::vector<size_t> starts{ 0 };
+        size_t done = 0;
+        for (size_t i = 0; i + 1 < jobs.size() && starts.size() < tasks; i++) {
+            done += jobs[i].end - jobs[i].begin;
+            if (done * tasks >= bytes * starts.size()) {
+                starts.push_back(i + 1);
+            }
+        }
+        starts.push_back(jobs.size());
+
+        std::atomic<bool> failed{ false };
+        auto task = [&](size_t i) {
+            for (auto j = starts[i]; j < starts[i + 1] && !failed.load(std::memory_order_relaxed); j++) {
+                auto& job = jobs[j];
+                if (!job.decode(job.container, job.index, job.begin, job.end)) {
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+        };
+        if (starts.size() == 2) {
+            task(0);
+        } else {
+            executor(starts.size() - 1, std::function<void(size_t)>(task));
+        }
+        return !failed.load();
+    }
+
+    // Decodes the payload into element, which was just added to container, and takes it out again if the payload
+    // does not decode. Put off to a task under DecodeParallel().
+    template <typename C>
+    ALWAYS_INLINE bool DecodeElement(C& container, typename C::value_type& element)
+    {
+        if constexpr (!is_lazy_v<typename C::value_type>) {
+            if (defer_ != nullptr) [[unlikely]] {
+                defer_->push_back({ &container, container.size() - 1, ptr_, end_, &DecodeJob<C> });
+                ptr_ = end_;
+                return true;
+            }
+        }
+
+        if (!Decode(element)) {
+            container.pop_back();
+            return false;
+        }
+        return true;
+    }
+
+    // Decodes only the fields in mask, a FieldMask or Fields. The others are skipped by their length on the wire,
+    // nothing is allocated for them.
+    template <typename T, typename Mask>
+        requires(is_message_v<T> && requires { T::__order__; })
+    bool Decode(T& value, const Mask& mask)
+    {
+        uint32_t last = T::__meta__.size();
+        size_t next = 0;
+        bool ok = DecodeFields([&](Decoder& d, uint64_t tag) {
+            auto index = NextField<T>(tag, last);
+            if (index == T::__meta__.size() || !mask.Has(index)) {
+                return true;
+            }
+
+            if constexpr (requires { mask.Nested(index); }) {
+                d.mask_ = mask.Nested(index);
+            }
+            if constexpr (requires { T::template __parse_table__<Decoder>(); }) {
+                const auto& table = T::template __parse_table__<Decoder>();
+                auto entry = table.Find(tag, next);
+                return entry == nullptr || entry->Parse(d, &value);
+            } else {
+                return value.DecodeField(d, index);
+            }
+        });
+        return Built(value, ok);
+    }
+
+    // Clears value and decodes into it. Strings and containers keep their capacity (see the generated Clear()).
+    // With clear=spare sub-messages, repeated messages and repeated strings keep their objects too, so a loop that
+    // decodes into the same message stops allocating once those are large enough.
+    template <typename T>
+        requires(is_message_v<T>)
+    bool DecodeReuse(T& value)
+    {
+        value.Clear();
+        return Decode(value);
+    }
+
+    // Decodes into a message created in arena, see Arena. nullptr if the input does not decode, the partly decoded
+    // message is left to the arena.
+    template <typename T>
+        requires(is_message_v<T>)
+    T* Decode(Arena& arena)
+    {
+        auto value = arena.template Create<T>();
+        return Decode(*value) ? value : nullptr;
+    }
+
+    template <typename Msg, int index, typename T>
+    ALWAYS_INLINE bool Decode(T& value)
+    {
+        constexpr auto meta = Msg::__meta__[index];
+        if constexpr (is_string_v<T> || is_repeated<T>::value || is_map_v<T>) {
+            // decoded once they are whole, see Split()
+            if (stream_ != nullptr) [[unlikely]] {
+                return false;
+            }
+        }
+        if constexpr (is_boolean_v<T>) {
+            value = (*reinterpret_cast<const uint64_t*>(ptr_) != 0);
+            return true;
+        } else if constexpr (is_integral_v<T>) {
+            if constexpr (meta.encoding == ENCODING_FIXED) {
+                if (!DecodeRaw(value)) {
+                    return false;
+                }
+                return Empty();
+            }
+            uint64_t v = Encoding<meta.encoding>::Decode(*reinterpret_cast<const uint64_t*>(ptr_));
+
+            if (!Convert(v, value)) {
+                return false;
+            }
+            return true;
+        } else if constexpr (is_enum_v<T>) {
+            int32_t v;
+            if (!Convert(*reinterpret_cast<const uint64_t*>(ptr_), v)) {
+                return false;
+            }
+
+            value = static_cast<T>(v);
+            return true;
+        } else if constexpr (is_floating_point_v<T>) {
+            if (!DecodeRaw(value)) {
+                return false;
+            }
+            return Empty();
+        } else if constexpr (is_string_v<T>) {
+            if constexpr (std::is_same_v<T, std::string_view>) {
+                // a std::string_view member keeps pointing into the input
+                value = T{ reinterpret_cast<const char*>(ptr_), Size() };
+            } else {
+                // in place, a std::pmr::string keeps its allocator
+                value.assign(reinterpret_cast<const char*>(ptr_), Size());
+            }
+            return true;
+        } else if constexpr (is_repeated<T>::value) {
+            using EntryType = typename T::value_type;
+            if constexpr (is_boolean_v<EntryType>) {
+                auto offset = value.size();
+                value.resize(offset + Size());
+                for (size_t i = offset; i < value.size(); i++) {
+                    value[i] = (*(ptr_ + i - offset) != 0);
+                }
+                return true;
+            } else if constexpr (is_floating_point_v<EntryType>) {
+                if (!DecodeRaw(value)) {
+                    return false;
+                }
+
+                return true;
+            } else if constexpr (is_integral_v<EntryType>) {
+                if constexpr (meta.encoding == ENCODING_FIXED) {
+                    if (!DecodeRaw(value)) {
+                        return false;
+                    }
+
+                    return true;
                 } else {
-                    while (ptr_ < end_) {
-                        auto [ok, v] = DecodeVarint();
-                        if (!ok) {
+                    return DecodePackedVarint<meta.encoding>(value);
+                }
+            } else if constexpr (is_enum_v<EntryType>) {
+                return DecodePackedVarint<meta.encoding>(value);
+            }
+
+            std::unreachable();
+            return false;
+
+        } else if constexpr (is_map_v<T>) {
+            using KeyType = typename T::key_type;
+            using ValueType = typename T::mapped_type;
+
+            if constexpr (requires { value.Append(); }) {
+                // decoded in place at the end, sorted in once the message is decoded
+                MapEntry<KeyType, ValueType, meta.encoding> entry{ value.Append() };
+                if (!this->template Decode(entry)) {
+                    value.DropLast();
+                    return false;
+                }
+                return true;
+            } else {
+                // built with the allocator of the map, so moving it into the map does not copy
+                auto v = [&] {
+                    if constexpr (requires { value.get_allocator(); }) {
+                        return std::make_obj_using_allocator<std::pair<KeyType, ValueType>>(value.get_allocator());
+                    } else {
+                        return std::pair<KeyType, ValueType>{};
+                    }
+                }();
+                MapEntry<KeyType, ValueType, meta.encoding> entry{ v };
+                if (!this->template Decode(entry)) {
+                    return false;
+                }
+                value.emplace(std::move(v));
+                return true;
+            }
+        } else if constexpr (is_message_v<T>) {
+            return Decode(value);
+        }
+
+        std::unreachable();
+        return false;
+    }
+
+private:
+    // Decode(T&) but for the flat maps
+    template <typename T>
+    ALWAYS_INLINE bool DecodeMessage(T& value)
+    {
+        if constexpr (requires { T::__order__; }) {
+            // the nested mask of the field this is the payload of
+            if (mask_ != nullptr) [[unlikely]] {
+                return Decode(value, *std::exchange(mask_, nullptr));
+            }
+        }
+
+        if constexpr (is_lazy_v<T>) {
+            value.Assign(ptr_, Size());
+            ptr_ = end_;
+            return true;
+        } else if constexpr (requires { T::template __parse_table__<Decoder>(); }) {
+            const auto& table = T::template __parse_table__<Decoder>();
+            size_t next = 0;
+            return DecodeFields([&](Decoder& d, uint64_t tag, std::span<const uint8_t> field) {
+                auto entry = table.Find(tag, next);
+                if (entry == nullptr) {
+                    if constexpr (requires { value._unknown_fields_; }) {
+                        // kept once it is whole, see Split()
+                        if (d.stream_ != nullptr) [[unlikely]] {
                             return false;
                         }
+                        value._unknown_fields_.Add(field.data(), field.size());
+                    }
+                    return true;
+                }
+                return entry->Parse(d, &value);
+            });
+        } else if constexpr (requires { value._unknown_fields_; }) {
+            uint32_t last = T::__meta__.size();
+            return DecodeFields([&](Decoder& d, uint64_t tag, std::span<const uint8_t> field) {
+                auto index = NextField<T>(tag, last);
+                if (index == T::__meta__.size()) {
+                    // kept once it is whole, see Split()
+                    if (d.stream_ != nullptr) [[unlikely]] {
+                        return false;
+                    }
+                    value._unknown_fields_.Add(field.data(), field.size());
+                    return true;
+                }
+                return value.DecodeField(d, index);
+            });
+        } else if constexpr (requires { T::__order__; }) {
+            uint32_t last = T::__meta__.size();
+            return DecodeFields([&](Decoder& d, uint64_t tag) { return value.Decode(d, tag, last); });
+        } else {
+            return DecodeFields([&](Decoder& d, uint64_t tag) { return value.Decode(d, tag); });
+        }
+    }
+
+    // Flat maps take the entries of a message unsorted, see FlatMap. They are sorted once it is decoded, or failed
+    // to, so they stay usable.
+    template <typename T>
+    ALWAYS_INLINE static bool Built(T& value, bool ok)
+    {
+        if constexpr (requires { value.BuildMaps(); }) {
+            value.BuildMaps();
+        }
+        return ok;
+    }
 
-                        v = Encoding<meta.encoding>::Decode(v);
+    template <typename C>
+    static bool DecodeJob(void* container, size_t index, const uint8_t* begin, const uint8_t* end)
+    {
+        Decoder d{ begin, end };
+        return d.Decode((*static_cast<C*>(container))[index]);
+    }
 
-                        EntryType tmp;
-                        if (!Convert(v, tmp)) {
-                            return false;
-                        }
+    // Index of the field with tag, T::__meta__.size() if T has none. Guesses the field after the previous one like
+    // the generated Decode.
+    template <typename T>
+    ALWAYS_INLINE static uint32_t NextField(uint64_t tag, uint32_t& last)
+    {
+        constexpr auto& order = T::__order__;
+        auto index = order.next[last];
+        if (order.tags[index] != tag) [[unlikely]] {
+            auto tags = std::span(order.tags).first(T::__meta__.size());
+            index = order.tags[last] == tag ? last : std::ranges::find(tags, tag) - tags.begin();
+        }
+        last = index;
+        return index;
+    }
 
-                        value.push_back(tmp);
-                    }
-                    return Empty();
+    // Splits the buffer into fields and hands each payload to fn(decoder, tag), or to fn(decoder, tag, field) with
+    // the whole encoded field, tag included.
+    template <typename Fn>
+    ALWAYS_INLINE bool DecodeFields(Fn&& fn)
+    {
+        constexpr bool whole = std::is_invocable_v<Fn, Decoder&, uint64_t, std::span<const uint8_t>>;
+        auto call = [&](Decoder& d, uint64_t tag, const uint8_t* field, const uint8_t* end) {
+            if constexpr (whole) {
+                return fn(d, tag, std::span<const uint8_t>(field, end));
+            } else {
+                return fn(d, tag);
+            }
+        };
+
+        while (ptr_ < end_) {
+            auto field = ptr_;
+            auto [ok, tag] = DecodeVarint();
+
+            if (!ok) {
+                return Cut(field);
+            }
+
+            switch (tag & 0x07) {
+            case WIRE_VARINT: {
+                auto [ok, v] = DecodeVarint();
+                if (!ok) {
+                    return Cut(field);
                 }
-            } else if constexpr (is_enum_v<EntryType>) {
-                while (ptr_ < end_) {
-                    auto [ok, v] = DecodeVarint();
-                    if (!ok) {
-                        return false;
-                    }
 
-                    int32_t tmp;
-                    if (!Convert(v, tmp)) {
-                        return false;
-                    }
+                Decoder d{ reinterpret_cast<uint8_t*>(&v), sizeof(v) };
+                if (!call(d, tag, field, ptr_)) {
+                    return false;
+                }
+            } break;
+            case WIRE_FIXED32: {
+                if (Size() < 4) {
+                    return Cut(field);
+                }
 
-                    value.push_back(static_cast<EntryType>(tmp));
+                Decoder d{ ptr_, 4 };
+                if (!call(d, tag, field, ptr_ + 4)) {
+                    return false;
                 }
-                return Empty();
+                ptr_ += 4;
+            } break;
+            case WIRE_FIXED64: {
+                if (Size() < 8) {
+                    return Cut(field);
+                }
+
+                Decoder d{ ptr_, 8 };
+                if (!call(d, tag, field, ptr_ + 8)) {
+                    return false;
+                }
+                ptr_ += 8;
+            } break;
+            case WIRE_LENGTH_DELIM: {
+                auto [ok, length] = DecodeLength();
+                if (!ok) {
+                    return Split(call, tag, field);
+                }
+
+                Decoder d{ ptr_, length };
+                d.defer_ = jobs_;
+                if (!call(d, tag, field, ptr_ + length)) {
+                    return false;
+                }
+                ptr_ += length;
+            } break;
+            default:
+                return false;
             }
+        }
+        return ptr_ == end_;
+    }
 
-            std::unreachable();
+    // The field at field does not fit in the input. That is malformed, unless a StreamDecoder has more input to
+    // come: then the fields before it are decoded and it is left for the next round.
+    bool Cut(const uint8_t* field)
+    {
+        if (stream_ == nullptr) {
             return false;
+        }
+        ptr_ = field;
+        return true;
+    }
 
-        } else if constexpr (is_map_v<T>) {
-            using KeyType = typename T::key_type;
-            using ValueType = typename T::mapped_type;
+    // The length-delimited field at field does not fit in the input. With a StreamDecoder, a sub-message is entered
+    // and its payload is decoded as it arrives, see Enter(). Other fields wait until they are whole.
+    template <typename Call>
+    bool Split(Call& call, uint64_t tag, const uint8_t* field)
+    {
+        if (stream_ == nullptr) {
+            return false;
+        }
+        ptr_ = field;
+        DecodeVarint();
+        auto [ok, length] = DecodeVarint();
+        // protobuf limits messages to 2GB, StreamDecoder rejects the field once it has the whole length
+        if (!ok || length > std::numeric_limits<int32_t>::max()) {
+            return Cut(field);
+        }
+        auto end = stream_->offset + (ptr_ - stream_->origin) + length;
+        if (end > stream_->frames.back().end) {
+            // longer than the message it is in
+            return false;
+        }
 
-            std::pair<KeyType, ValueType> v;
-            MapEntry<KeyType, ValueType, meta.encoding> entry{ v };
-            if (!this->template Decode(entry)) {
-                return false;
-            }
-            value.emplace(std::move(v));
+        // the payload so far is not handed over, Enter() only records where it ends
+        Decoder d{ ptr_, ptr_ };
+        d.stream_ = stream_;
+        stream_->end = end;
+        auto depth = stream_->frames.size();
+        if (!call(d, tag, field, end_) || stream_->frames.size() == depth) {
+            return Cut(field);
+        }
+        return true;
+    }
+
+    // The payload of value goes on past the input. StreamDecoder decodes it into value as it arrives, and builds
+    // value once the payload is complete.
+    template <typename T>
+    bool Enter(T& value)
+    {
+        if constexpr (requires { T::__order__; }) {
+            stream_->frames.push_back({ &value, &DecodeFrame<T>, &BuildFrame<T>, stream_->end });
             return true;
-        } else if constexpr (is_message_v<T>) {
-            return Decode(value);
+        } else {
+            // a lazy field keeps its bytes, it waits until they are whole
+            return false;
         }
+    }
 
-        std::unreachable();
-        return false;
+    template <typename T>
+    static bool DecodeFrame(Decoder& dec, void* value)
+    {
+        return dec.DecodeMessage(*static_cast<T*>(value));
+    }
+
+    template <typename T>
+    static void BuildFrame(void* value)
+    {
+        Built(*static_cast<T*>(value), true);
+    }
+
+    template <typename T = uint64_t>
+    ALWAYS_INLINE std::tuple<bool, T> DecodeVarint()
+    {
+        if constexpr (sizeof(T) == 8) {
+            if (Size() >= 10) [[likely]] {
+                return DecodeVarintFast();
+            }
+        }
+        return DecodeVarintSlow<T>();
+    }
+
+    // Needs at least ten readable bytes, so no byte is bounds checked.
+    ALWAYS_INLINE std::tuple<bool, uint64_t> DecodeVarintFast()
+    {
+        auto p = ptr_;
+        uint64_t value = p[0];
+        if (!(value & 0x80)) [[likely]] {
+            ptr_ = p + 1;
+            return { true, value };
+        }
+
+#if defined(__BMI2__)
+        // values below 2^56 take at most eight bytes: find the terminator and gather the payload bits in one go
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        if constexpr (std::endian::native == std::endian::little) {
+            auto stop = ~word & 0x8080808080808080ULL;
+            if (stop != 0) {
+                auto bits = std::countr_zero(stop) + 1;
+                auto mask = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+                ptr_ = p + bits / 8;
+                return { true, _pext_u64(word & mask, 0x7F7F7F7F7F7F7F7FULL) };
+            }
+        }
+#endif
+
+        // every step adds the next byte and removes the continuation bit of the previous one
+        uint64_t b = p[1];
+        value += (b << 7) - 0x80;
+        if (!(b & 0x80)) {
+            ptr_ = p + 2;
+            return { true, value };
+        }
+        b = p[2];
+        value += (b << 14) - (0x80ULL << 7);
+        if (!(b & 0x80)) {
+            ptr_ = p + 3;
+            return { true, value };
+        }
+        b = p[3];
+        value += (b << 21) - (0x80ULL << 14);
+        if (!(b & 0x80)) {
+            ptr_ = p + 4;
+            return { true, value };
+        }
+        b = p[4];
+        value += (b << 28) - (0x80ULL << 21);
+        if (!(b & 0x80)) {
+            ptr_ = p + 5;
+            return { true, value };
+        }
+        b = p[5];
+        value += (b << 35) - (0x80ULL << 28);
+        if (!(b & 0x80)) {
+            ptr_ = p + 6;
+            return { true, value };
+        }
+        b = p[6];
+        value += (b << 42) - (0x80ULL << 35);
+        if (!(b & 0x80)) {
+            ptr_ = p + 7;
+            return { true, value };
+        }
+        b = p[7];
+        value += (b << 49) - (0x80ULL << 42);
+        if (!(b & 0x80)) {
+            ptr_ = p + 8;
+            return { true, value };
+        }
+        b = p[8];
+        value += (b << 56) - (0x80ULL << 49);
+        if (!(b & 0x80)) {
+            ptr_ = p + 9;
+            return { true, value };
+        }
+        b = p[9];
+        if (b > 1) {
+            // overflow
+            return { false, 0 };
+        }
+        value += (b << 63) - (0x80ULL << 56);
+        ptr_ = p + 10;
+        return { true, value };
     }
 
-private:
     template <typename T = uint64_t>
-    std::tuple<bool, T> DecodeVarint()
+    std::tuple<bool, T> DecodeVarintSlow()
     {
         T value = 0;
         size_t n = 0;
@@ -423,6 +1453,45 @@ private:
         return { true, value };
     }
 
+    // Appends the elements of a packed varint field. The payload is counted first, so the vector grows once even
+    // when the field is split over several records on the wire.
+    template <auto encoding, RepeatedContainer C>
+    bool DecodePackedVarint(C& value)
+    {
+        using T = typename C::value_type;
+        if (Empty()) {
+            return true;
+        }
+        if (*(end_ - 1) & 0x80) {
+            // truncated
+            return false;
+        }
+
+        auto offset = value.size();
+        value.resize(offset + simd::CountVarints(ptr_, Size()));
+        auto fail = [&] {
+            value.resize(offset);
+            return false;
+        };
+        for (auto it = value.begin() + offset; it != value.end(); ++it) {
+            auto [ok, v] = DecodeVarint();
+            if (!ok) {
+                return fail();
+            }
+
+            if constexpr (is_enum_v<T>) {
+                int32_t tmp;
+                if (!Convert(v, tmp)) {
+                    return fail();
+                }
+                *it = static_cast<T>(tmp);
+            } else if (!Convert(Encoding<encoding>::Decode(v), *it)) {
+                return fail();
+            }
+        }
+        return true;
+    }
+
     ALWAYS_INLINE std::tuple<bool, uint64_t> DecodeLength()
     {
         auto [ok, size] = DecodeVarint();
@@ -447,24 +1516,39 @@ private:
         return true;
     }
 
-    template <typename T>
-    ALWAYS_INLINE bool DecodeRaw(std::vector<T>& value)
+    template <RepeatedContainer C>
+    ALWAYS_INLINE bool DecodeRaw(C& value)
     {
+        using T = typename C::value_type;
         size_t size = end_ - ptr_;
         if (size % sizeof(T) != 0) {
             return false;
         }
 
-        value.resize(size / sizeof(T));
+        // appended, a field may be split over several records
+        auto offset = value.size();
+        value.resize(offset + size / sizeof(T));
         if constexpr (std::endian::native == std::endian::big) {
-            for (auto& v : value) {
-                v = std::byteswap(*reinterpret_cast<const T*>(ptr_));
+            for (auto it = value.begin() + offset; it != value.end(); ++it) {
+                *it = std::byteswap(*reinterpret_cast<const T*>(ptr_));
                 ptr_ += sizeof(T);
             }
         } else {
-            std::memcpy(value.data(), ptr_, size);
+            std::memcpy(value.data() + offset, ptr_, size);
+            ptr_ += size;
         }
-        ptr_ += sizeof(T);
+        return true;
+    }
+
+    // packed=view: no copy when the payload can be pointed at, see PackedView
+    template <typename T>
+    ALWAYS_INLINE bool DecodeRaw(PackedView<T>& value)
+    {
+        if (Size() % sizeof(T) != 0) {
+            return false;
+        }
+        value.Append(ptr_, Size());
+        ptr_ = end_;
         return true;
     }
 
@@ -493,6 +1577,330 @@ private:
 
     const uint8_t* ptr_;
     const uint8_t* end_;
+    // set for the payload of a field that has a nested mask, see Decode(T&, const Mask&)
+    const FieldMask* mask_;
+    // set by DecodeParallel(), the payloads of the fields get it as defer_
+    std::vector<ParallelJob>* jobs_;
+    // where DecodeElement() puts off the elements of a repeated message field
+    std::vector<ParallelJob>* defer_;
+
+    template <typename T>
+        requires(is_message_v<T>)
+    friend class StreamDecoder;
+
+    // a message StreamDecoder is decoding into, whose payload has not arrived in full
+    struct Frame
+    {
+        void* value;
+        bool (*decode)(Decoder& dec, void* value);
+        void (*build)(void* value);
+        // stream offset where its payload ends
+        uint64_t end;
+    };
+
+    struct Stream
+    {
+        // the innermost message last
+        std::vector<Frame> frames;
+        // stream offset of origin
+        uint64_t offset;
+        const uint8_t* origin;
+        // where the payload ends that Split() enters
+        uint64_t end;
+    };
+
+    // set by StreamDecoder while the input ends before the message does, and for the payload Split() enters
+    Stream* stream_;
+};
+
+// Executor for DecodeParallel() that starts its threads for each call, the calling thread being one of them.
+class ThreadExecutor
+{
+public:
+    explicit ThreadExecutor(size_t threads = std::thread::hardware_concurrency())
+      : threads_(std::max<size_t>(threads, 1))
+    {
+    }
+
+    void operator()(size_t count, const std::function<void(size_t)>& task) const
+    {
+        std::atomic<size_t> next{ 0 };
+        auto run = [&] {
+            for (auto i = next++; i < count; i = next++) {
+                task(i);
+            }
+        };
+
+        std::vector<std::jthread> threads;
+        for (size_t i = 1; i < std::min(threads_, count); i++) {
+            threads.emplace_back(run);
+        }
+        run();
+    }
+
+private:
+    size_t threads_;
+};
+
+// Decodes a message whose encoding arrives in pieces, e.g. as it is read from a socket. Each Feed() decodes the
+// fields that are complete so far straight from the piece, the message is merged field by field like
+// Decoder::Decode does. A sub-message split between pieces is entered, its fields decode as they arrive and the
+// decoder resumes inside it on the next Feed(). Only a field that can not be entered, a string, bytes, packed,
+// map, lazy or unknown field, is copied until its last byte arrives.
+//
+// Not for messages generated with string=view, packed=view or unknown=view: their fields would point into the
+// pieces, or into the copy of a split field, which goes away once it is decoded.
+template <typename T>
+    requires(is_message_v<T>)
+class StreamDecoder
+{
+    static_assert(!views_buffer_v<T>, "the message would point into the pieces, see views_buffer_v");
+
+public:
+    explicit StreamDecoder(T& value)
+      : stream_{ { { &value, &Decoder::DecodeFrame<T>, &Decoder::BuildFrame<T>, UINT64_MAX } }, 0, nullptr, 0 }
+      , whole_(false)
+      , pos_(0)
+      , failed_(false)
+    {
+    }
+
+    // false if the input is malformed, the decoder then rejects all further input.
+    bool Feed(const uint8_t* data, size_t size)
+    {
+        if (failed_) {
+            return false;
+        }
+
+        // complete the split field first, taking no more than it needs
+        while (!pending_.empty()) {
+            auto [state, n] = Scan(Bytes(pending_.data()), Bytes(pending_.data()) + pending_.size());
+            if (state == State::Malformed) {
+                return Fail();
+            }
+            if (state == State::Complete || (state == State::Partial && !whole_)) {
+                auto ptr = Bytes(pending_.data());
+                if (!Run(ptr, ptr + pending_.size())) {
+                    return Fail();
+                }
+                if (auto used = ptr - Bytes(pending_.data()); used != 0) {
+                    pending_.erase(0, used);
+                    whole_ = false;
+                    continue;
+                }
+                if (state == State::Complete) {
+                    return Fail();
+                }
+                // not a sub-message, it waits until it is whole
+                whole_ = true;
+            }
+            if (size == 0) {
+                return true;
+            }
+            auto take = std::min<size_t>(n, size);
+            pending_.append(reinterpret_cast<const char*>(data), take);
+            data += take;
+            size -= take;
+        }
+
+        auto ptr = data;
+        if (!Run(ptr, data + size)) {
+            return Fail();
+        }
+        pending_.assign(reinterpret_cast<const char*>(ptr), data + size - ptr);
+        whole_ = false;
+        return true;
+    }
+
+    bool Feed(std::string_view data) { return Feed(Bytes(data.data()), data.size()); }
+
+    // true while a field or a sub-message is split, the message is not complete before more input arrives
+    bool NeedMore() const { return !pending_.empty() || stream_.frames.size() > 1; }
+
+    // Ends the input. true if it was a complete message, which is then built, see Decoder::Built().
+    bool Finish()
+    {
+        if (failed_ || NeedMore()) {
+            return false;
+        }
+        auto& top = stream_.frames.front();
+        top.build(top.value);
+        return true;
+    }
+
+private:
+    enum class State
+    {
+        Complete,
+        // the payload is incomplete
+        Partial,
+        // the tag, the length or the varint is incomplete
+        Header,
+        Malformed,
+    };
+
+    static const uint8_t* Bytes(const char* p) { return reinterpret_cast<const uint8_t*>(p); }
+
+    // Decodes [ptr, end) into the innermost split message, going into the sub-messages that start there and out of
+    // those that end. ptr is left at the field that is cut off by end.
+    bool Run(const uint8_t*& ptr, const uint8_t* end)
+    {
+        auto& frames = stream_.frames;
+        while (true) {
+            auto frame = frames.back();
+            auto left = frame.end - pos_;
+            bool cut = left > uint64_t(end - ptr);
+            Decoder dec{ ptr, cut ? end : ptr + left };
+            if (cut) {
+                stream_.offset = pos_;
+                stream_.origin = ptr;
+                dec.stream_ = &stream_;
+            }
+
+            auto depth = frames.size();
+            if (!frame.decode(dec, frame.value)) {
+                return false;
+            }
+            pos_ += dec.ptr_ - ptr;
+            ptr = dec.ptr_;
+            if (frames.size() > depth) {
+                continue;
+            }
+            if (cut) {
+                return true;
+            }
+            frame.build(frame.value);
+            frames.pop_back();
+        }
+    }
+
+    // Finds the end of the field at ptr. Complete with the size of the field, Partial with the number of payload
+    // bytes still missing, or Header with one while the tag, the length or the varint is incomplete.
+    static std::tuple<State, size_t> Scan(const uint8_t* ptr, const uint8_t* end)
+    {
+        auto begin = ptr;
+        auto varint = [&](uint64_t& value) {
+            value = 0;
+            for (size_t n = 0; n < 10; n++) {
+                if (ptr == end) {
+                    return State::Header;
+                }
+                auto b = *ptr++;
+                value |= uint64_t(b & 0x7F) << (n * 7);
+                if (!(b & 0x80)) {
+                    return State::Complete;
+                }
+            }
+            // overflow
+            return State::Malformed;
+        };
+
+        uint64_t tag;
+        if (auto state = varint(tag); state != State::Complete) {
+            return { state, 1 };
+        }
+
+        uint64_t size;
+        switch (tag & 0x07) {
+        case WIRE_VARINT: {
+            uint64_t v;
+            if (auto state = varint(v); state != State::Complete) {
+                return { state, 1 };
+            }
+            size = 0;
+        } break;
+        case WIRE_FIXED32:
+            size = 4;
+            break;
+        case WIRE_FIXED64:
+            size = 8;
+            break;
+        case WIRE_LENGTH_DELIM: {
+            if (auto state = varint(size); state != State::Complete) {
+                return { state, 1 };
+            }
+            // protobuf limits messages to 2GB
+            if (size > std::numeric_limits<int32_t>::max()) {
+                return { State::Malformed, 0 };
+            }
+        } break;
+        default:
+            return { State::Malformed, 0 };
+        }
+
+        size_t available = end - ptr;
+        if (available < size) {
+            return { State::Partial, size - available };
+        }
+        return { State::Complete, ptr + size - begin };
+    }
+
+    bool Fail()
+    {
+        failed_ = true;
+        pending_.clear();
+        return false;
+    }
+
+    // the split messages, the top-level one first
+    Decoder::Stream stream_;
+    // the beginning of a field that is split between pieces
+    std::string pending_;
+    // pending_ holds a field that is not a sub-message, so it is only decoded once it is whole
+    bool whole_;
+    // the number of bytes decoded so far
+    uint64_t pos_;
+    bool failed_;
 };
 
+// Decodes a message held in several buffers, e.g. an iovec list from readv() or the two halves of a wrapped ring
+// buffer. Segments are iovecs or contiguous byte ranges (std::string_view, std::span<const uint8_t>, ...).
+// Segments that follow each other in memory are joined, and input that turns out to be contiguous decodes like
+// Decoder::Decode. Otherwise the runs go through a StreamDecoder: fields and sub-messages decode in place, only a
+// string, bytes, packed, map, lazy or unknown field crossing a boundary is copied. Like it, not for messages that
+// point into the decoded buffer.
+template <typename T, std::ranges::input_range Segments>
+    requires(is_message_v<T>)
+bool DecodeSegments(T& value, Segments&& segments)
+{
+    std::optional<StreamDecoder<T>> stream;
+    const uint8_t* begin = nullptr;
+    const uint8_t* end = nullptr;
+    for (const auto& segment : segments) {
+        const uint8_t* data;
+        size_t size;
+        if constexpr (requires { segment.iov_base, segment.iov_len; }) {
+            data = static_cast<const uint8_t*>(segment.iov_base);
+            size = segment.iov_len;
+        } else {
+            static_assert(sizeof(std::ranges::range_value_t<decltype(segment)>) == 1);
+            data = reinterpret_cast<const uint8_t*>(std::ranges::data(segment));
+            size = std::ranges::size(segment);
+        }
+        if (size == 0) {
+            continue;
+        }
+        if (data == end) {
+            end += size;
+            continue;
+        }
+        if (begin != nullptr) {
+            if (!stream) {
+                stream.emplace(value);
+            }
+            if (!stream->Feed(begin, end - begin)) {
+                return false;
+            }
+        }
+        begin = data;
+        end = data + size;
+    }
+
+    if (!stream) {
+        Decoder dec{ begin, end };
+        return dec.Decode(value);
+    }
+    return stream->Feed(begin, end - begin) && stream->Finish();
+}
+
 } // namespace kun
\ No newline at end of file
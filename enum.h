@@ -1,4 +1,5 @@
 #pragma once
+#include <options.h>
 #include <protobuf.h>
 
 class EnumGenerator
@@ -3,8 +3,10 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <unordered_set>
 
 #include <google/protobuf/io/printer.h>
+#include <options.h>
 #include <protobuf.h>
 
 #include "kun.h"
@@ -32,6 +34,15 @@ std::string GetTypeName(const FieldDescriptor* fd)
     return typenames[fd->cpp_type()];
 }
 
+// strings of messages generated with alloc=arena allocate from the arena
+std::string GetTypeName(const FieldDescriptor* fd, const Options& options)
+{
+    if (options.arena && fd->cpp_type() == CppType::CPPTYPE_STRING) {
+        return "::std::pmr::string";
+    }
+    return GetTypeName(fd);
+}
+
 kun::EncodingType GetEncodingType(const FieldDescriptor* field)
 {
     switch (field->type()) {
@@ -100,6 +111,81 @@ uint64_t MakeTag(const FieldDescriptor* desc)
     return (tag << 3) | t;
 }
 
+// sub-messages marked [lazy = true] are parsed on first access
+bool IsLazy(const FieldDescriptor* field, const Options& options)
+{
+    return field->cpp_type() == CppType::CPPTYPE_MESSAGE && !field->is_map() && field->options().lazy();
+}
+
+// packed=view: repeated fixed-width fields are ::kun::PackedView
+bool IsPackedView(const FieldDescriptor* field, const Options& options)
+{
+    return options.packedView && field->is_repeated() && !field->is_map() &&
+      (field->cpp_type() == CppType::CPPTYPE_FLOAT || field->cpp_type() == CppType::CPPTYPE_DOUBLE ||
+       GetEncodingType(field) == kun::ENCODING_FIXED);
+}
+
+// whether decoded messages of type desc point into the decoded buffer, through string=view strings, packed=view
+// fields or unknown=view unknown fields of their own or of a sub-message. Lazy sub-messages decode from their own
+// copy.
+bool ViewsBuffer(const Descriptor* desc, const Options& options, std::unordered_set<const Descriptor*>& visited)
+{
+    if (options.unknown == Options::Unknown::View) {
+        return true;
+    }
+    if (!visited.insert(desc).second) {
+        return false;
+    }
+    for (int i = 0; i < desc->field_count(); i++) {
+        auto field = desc->field(i);
+        if (field->is_map()) {
+            // keys and values stay std::string
+            field = field->message_type()->map_value();
+        } else if ((options.stringView && field->cpp_type() == CppType::CPPTYPE_STRING) ||
+                   IsPackedView(field, options)) {
+            return true;
+        }
+        if (field->message_type() != nullptr && !IsLazy(field, options) &&
+            ViewsBuffer(field->message_type(), options, visited)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// whether a message of type desc can hold a message of type target, through fields of any kind
+bool CanHold(const Descriptor* desc, const Descriptor* target, std::unordered_set<const Descriptor*>& visited)
+{
+    if (desc == target) {
+        return true;
+    }
+    if (!visited.insert(desc).second) {
+        return false;
+    }
+    for (int i = 0; i < desc->field_count(); i++) {
+        auto type = desc->field(i)->message_type();
+        if (type != nullptr && CanHold(type, target, visited)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// message=inline: a singular sub-message is a ::kun::Inline member, unless its type is recursive and can hold the
+// message that holds it, which would then contain itself
+bool IsInline(const FieldDescriptor* field, const Options& options)
+{
+    if (field->cpp_type() != CppType::CPPTYPE_MESSAGE || field->is_repeated() || field->real_containing_oneof() ||
+        IsLazy(field, options) || options.arena) {
+        return false;
+    }
+    if (!options.inlineMessage && !options.inlineMessages.contains(field->full_name())) {
+        return false;
+    }
+    std::unordered_set<const Descriptor*> visited;
+    return !CanHold(field->message_type(), field->containing_type(), visited);
+}
+
 class FieldGeneratorBase
 {
 public:
@@ -118,6 +204,10 @@ public:
 
     virtual void GenerateEncode(Printer& p) const
     {
+        if (HasBit()) {
+            p.Emit("enc.template Encode<$class$, $index$>($name$);\n");
+            return;
+        }
         p.Emit(R"cc(
         if (::$kun_ns$::HasValue($name$)) {
             enc.template Encode<$class$, $index$>($name$);
@@ -125,20 +215,128 @@ public:
         )cc");
     }
 
+    virtual void GenerateEncodeReverse(Printer& p) const { FieldGeneratorBase::GenerateEncode(p); }
+
     virtual void GenerateDecode(Printer& p) const
     {
+        if (HasBit()) {
+            p.Emit(R"cc(
+            case $index$: {
+                _has_bits_.Set($bit$);
+                return dec.template Decode<$class$, $index$>($name$);
+            }
+            )cc");
+            return;
+        }
         p.Emit(R"cc(
-        case __meta__[$index$].tag: {
+        case $index$: {
             return dec.template Decode<$class$, $index$>($name$);
         }
         )cc");
     }
 
+    // presence=bits: singular scalar and string fields with explicit presence have a presence bit. Fields with
+    // implicit presence have none, they are written when they are not zero, so assigning them directly works.
+    bool HasBit() const
+    {
+        return options_.hasBits && !field_->is_repeated() && field_->cpp_type() != CppType::CPPTYPE_MESSAGE &&
+               field_->has_presence();
+    }
+
+    // the presence bit, the position of the field in field number order
+    size_t Bit() const
+    {
+        auto desc = field_->containing_type();
+        size_t bit = 0;
+        for (int i = 0; i < desc->field_count(); i++) {
+            bit += desc->field(i)->number() < field_->number();
+        }
+        return bit;
+    }
+
+    virtual void GenerateAccessors(Printer& p) const
+    {
+        if (!HasBit()) {
+            return;
+        }
+        p.Emit(R"cc(
+        inline bool has_$name$() const { return _has_bits_.Test($bit$); }
+
+        inline void set_$name$($type$ value)
+        {
+            $name$ = std::move(value);
+            _has_bits_.Set($bit$);
+        }
+
+        inline void clear_$name$()
+        {
+            ::$kun_ns$::Clear($name$);
+            _has_bits_.Reset($bit$);
+        }
+        )cc");
+    }
+
+    // entry of the message parse table, see Options::tableDecode
+    virtual void GenerateParseEntry(Printer& p) const
+    {
+        if (HasSpare()) {
+            p.Emit(R"cc(
+            ::$kun_ns$::MakeParseEntry<Decoder, $class$, $index$, &$class$::$name$, &$class$::_$name$_spare_>(),
+            )cc");
+            return;
+        }
+        if (HasBit()) {
+            // the bit is the rank of the field, not the position of the entry: oneof message fields have none
+            p.Emit(R"cc(
+            ::$kun_ns$::MakeParseEntry<Decoder, $class$, $index$, &$class$::$name$, nullptr, $bit$>(),
+            )cc");
+            return;
+        }
+        p.Emit(R"cc(
+        ::$kun_ns$::MakeParseEntry<Decoder, $class$, $index$, &$class$::$name$>(),
+        )cc");
+    }
+
+    // fields whose cleared objects are kept for the next decode, see ::kun::Clear()
+    virtual bool HasSpare() const { return false; }
+
+    // alignment of the member, the spare and cached size members that come with it are all 8-byte aligned
+    size_t Alignment() const
+    {
+        if (field_->is_repeated()) {
+            return 8;
+        }
+        switch (field_->cpp_type()) {
+        case CppType::CPPTYPE_BOOL:
+            return 1;
+        case CppType::CPPTYPE_INT32:
+        case CppType::CPPTYPE_UINT32:
+        case CppType::CPPTYPE_FLOAT:
+        case CppType::CPPTYPE_ENUM:
+            return 4;
+        default:
+            return 8;
+        }
+    }
+
+    virtual void GenerateClear(Printer& p) const
+    {
+        if (HasSpare()) {
+            p.Emit("::$kun_ns$::Clear($name$, _$name$_spare_);\n");
+        } else {
+            p.Emit("::$kun_ns$::Clear($name$);\n");
+        }
+    }
+
     virtual void GenerateByteSize(Printer& p) const
     {
+        if (HasBit()) {
+            p.Emit("total_size += ::$kun_ns$::ByteSizeWithTag<$class$, $index$>($name$, _sizes_);\n");
+            return;
+        }
         p.Emit(R"cc(
         if (::$kun_ns$::HasValue($name$)) {
-            total_size += ::$kun_ns$::ByteSizeWithTag<$class$, $index$>($name$);
+            total_size += ::$kun_ns$::ByteSizeWithTag<$class$, $index$>($name$, _sizes_);
         } 
         )cc");
     }
@@ -152,11 +350,100 @@ public:
 
     virtual void GenerateCopyConstructor(Printer& p) const { p.Emit("$name$(other.$name$)\n"); }
 
-    virtual void GenerateMoveConstructor(Printer& p) const { p.Emit("$name$(std::move(other.$name$))\n"); }
+    virtual void GenerateMoveConstructor(Printer& p) const
+    {
+        p.Emit("$name$(std::move(other.$name$))\n");
+        if (HasSpare()) {
+            p.Emit(", _$name$_spare_(std::move(other._$name$_spare_))\n");
+        }
+    }
+
+    // alloc=arena: members that allocate are constructed with the allocator of the message. Packed views and custom
+    // containers are rejected with it, see Generator::ParseOptions().
+    bool UsesAllocator() const
+    {
+        return options_.arena &&
+          (field_->is_repeated() ||
+           (field_->cpp_type() == CppType::CPPTYPE_MESSAGE && !field_->is_repeated()) ||
+           (field_->cpp_type() == CppType::CPPTYPE_STRING && !field_->is_repeated() && !options_.stringView));
+    }
+
+    // map fields with a container of their own, which may sort its entries once decoded, see ::kun::FlatMap
+    bool BuildsMap() const { return field_->is_map() && !Container().empty(); }
+
+    // the container template chosen with container=, repeated= or map=, empty for the default one
+    std::string Container() const
+    {
+        if (auto it = options_.containers.find(field_->full_name()); it != options_.containers.end()) {
+            return it->second;
+        }
+        if (field_->is_map()) {
+            return options_.mapContainer;
+        }
+        if (field_->is_repeated() && field_->cpp_type() != CppType::CPPTYPE_MESSAGE) {
+            return options_.repeatedContainer;
+        }
+        return "";
+    }
+
+    bool IsPackedView() const { return ::IsPackedView(field_, options_); }
+
+    void GenerateAllocatorConstructor(Printer& p) const
+    {
+        if (UsesAllocator()) {
+            p.Emit("$name$(alloc)\n");
+            GenerateAllocatorSpare(p);
+        } else {
+            GenerateConstructor(p);
+        }
+    }
+
+    void GenerateAllocatorCopyConstructor(Printer& p) const
+    {
+        if (UsesAllocator()) {
+            p.Emit("$name$(other.$name$, alloc)\n");
+            GenerateAllocatorSpare(p);
+        } else {
+            GenerateCopyConstructor(p);
+        }
+    }
+
+    void GenerateAllocatorMoveConstructor(Printer& p) const
+    {
+        if (UsesAllocator()) {
+            p.Emit("$name$(std::move(other.$name$), alloc)\n");
+            GenerateAllocatorSpare(p);
+        } else {
+            GenerateMoveConstructor(p);
+        }
+    }
+
+    // a new element of a repeated field, taken from the spare member if there is one
+    std::string Emplace() const
+    {
+        auto name = google::protobuf::compiler::cpp::FieldName(field_);
+        if (HasSpare()) {
+            return "::kun::EmplaceBack(" + name + ", _" + name + "_spare_)";
+        }
+        return name + ".emplace_back()";
+    }
+
+    void GenerateAllocatorSpare(Printer& p) const
+    {
+        if (HasSpare()) {
+            p.Emit(", _$name$_spare_(alloc)\n");
+        }
+    }
 
     virtual void GenerateAssignment(Printer& p) const { p.Emit("$name$ = other.$name$;\n"); }
 
-    virtual void GenerateMoveAssignment(Printer& p) const { p.Emit("$name$ = std::move(other.$name$);\n"); }
+    virtual void GenerateMoveAssignment(Printer& p) const
+    {
+        p.Emit("$name$ = std::move(other.$name$);\n");
+        if (HasSpare()) {
+            p.Emit("_$name$_spare_ = std::move(other._$name$_spare_);\n");
+        }
+    }
 
     virtual void GenerateEqual(Printer& p) const
     {
@@ -178,16 +465,34 @@ public:
             c = GetEncodingType(field_);
         }
 
+        auto container = Container();
         return {
             { "name", google::protobuf::compiler::cpp::FieldName(field_) },
-            { "type", GetTypeName(field_) },
+            { "type", TypeName() },
             { "number", field_->number() },
             { "index", index_ },
+            { "bit", Bit() },
             { "tag", MakeTag(field_) },
             { "encoding", c },
+            { "vector", !container.empty() ? container : options_.arena ? "std::pmr::vector" : "std::vector" },
+            { "map",
+              !container.empty() ? container : options_.arena ? "std::pmr::unordered_map" : "std::unordered_map" },
+            { "ptr", options_.arena ? "::kun::ArenaPtr" : "std::unique_ptr" },
         };
     }
 
+    // C++ type of the field, of an element for repeated fields
+    std::string TypeName() const
+    {
+        if (options_.stringView && field_->cpp_type() == CppType::CPPTYPE_STRING) {
+            return "::std::string_view";
+        }
+        if (IsLazy(field_, options_)) {
+            return "::kun::Lazy<" + GetTypeName(field_) + ">";
+        }
+        return GetTypeName(field_, options_);
+    }
+
     virtual ~FieldGeneratorBase(){};
 
 protected:
@@ -246,13 +551,21 @@ public:
     {
     }
 
-    void GenerateMembers(Printer& p) const override { p.Emit("std::unique_ptr<$type$> $name$;\n"); }
+    void GenerateMembers(Printer& p) const override
+    {
+        p.Emit("$ptr$<$type$> $name$;\n");
+        if (HasSpare()) {
+            p.Emit("$ptr$<$type$> _$name$_spare_;\n");
+        }
+    }
+
+    bool HasSpare() const override { return options_.spare; }
 
     void GenerateByteSize(Printer& p) const override
     {
         p.Emit(R"cc(
         if($name$) {
-            total_size += ::$kun_ns$::ByteSizeWithTag<$class$, $index$>(*$name$);
+            total_size += ::$kun_ns$::ByteSizeWithTag<$class$, $index$>(*$name$, _sizes_);
         }
         )cc");
     }
@@ -267,12 +580,21 @@ public:
           )cc");
     }
 
+    void GenerateEncodeReverse(Printer& p) const override { GenerateEncode(p); }
+
     void GenerateDecode(Printer& p) const override
     {
+        if (!HasSpare()) {
+            p.Emit(R"cc(
+            case $index$: {
+                return dec.Decode(::$kun_ns$::EmplaceMessage($name$));
+            }
+            )cc");
+            return;
+        }
         p.Emit(R"cc(
-        case __meta__[$index$].tag: {
-            $name$ = std::make_unique<$type$>();
-            return dec.Decode(*$name$);
+        case $index$: {
+            return dec.Decode(::$kun_ns$::EmplaceMessage($name$, &_$name$_spare_));
         }
         )cc");
     }
@@ -284,6 +606,11 @@ public:
 
     void GenerateAssignment(Printer& p) const override
     {
+        if (options_.arena) {
+            // ArenaPtr copies the sub-message into its own arena
+            FieldGeneratorBase::GenerateAssignment(p);
+            return;
+        }
         p.Emit("$name$ = other.$name$ ? std::make_unique<$type$>(*other.$name$): nullptr;\n");
     }
 
@@ -297,6 +624,57 @@ public:
     }
 };
 
+// message=inline: ::kun::Inline in place of the pointer, copied, compared and moved as a value. It needs no spare,
+// Clear() clears the sub-message in place.
+class InlineMessageFieldGenerator : public MessageFieldGenerator
+{
+public:
+    InlineMessageFieldGenerator(const FieldDescriptor* field, size_t index, const Options& options)
+      : MessageFieldGenerator(field, index, options)
+    {
+    }
+
+    void GenerateMembers(Printer& p) const override { p.Emit("::$kun_ns$::Inline<$type$> $name$;\n"); }
+
+    bool HasSpare() const override { return false; }
+
+    void GenerateCopyConstructor(Printer& p) const override { FieldGeneratorBase::GenerateCopyConstructor(p); }
+
+    void GenerateAssignment(Printer& p) const override { FieldGeneratorBase::GenerateAssignment(p); }
+
+    void GenerateEqual(Printer& p) const override { FieldGeneratorBase::GenerateEqual(p); }
+};
+
+class LazyMessageFieldGenerator : public FieldGeneratorBase
+{
+public:
+    LazyMessageFieldGenerator(const FieldDescriptor* field, size_t index, const Options& options)
+      : FieldGeneratorBase(field, index, options)
+    {
+    }
+
+    void GenerateByteSize(Printer& p) const override
+    {
+        p.Emit(R"cc(
+        if($name$) {
+            total_size += ::$kun_ns$::ByteSizeWithTag<$class$, $index$>($name$, _sizes_);
+        }
+        )cc");
+    }
+
+    void GenerateEncode(Printer& p) const override
+    {
+        p.Emit(
+          R"cc(
+          if($name$) {
+              enc.template Encode<$class$, $index$>($name$);
+          }
+          )cc");
+    }
+
+    void GenerateEncodeReverse(Printer& p) const override { GenerateEncode(p); }
+};
+
 class EnumFieldGenerator : public FieldGeneratorBase
 {
 public:
@@ -317,7 +695,11 @@ public:
 
     void GenerateMembers(Printer& p) const override
     {
-        p.Emit("std::vector<$type$> $name$;\n");
+        if (IsPackedView()) {
+            p.Emit("::kun::PackedView<$type$> $name$;\n");
+        } else {
+            p.Emit("$vector$<$type$> $name$;\n");
+        }
         if (encoding_ != kun::ENCODING_FIXED) {
             p.Emit("mutable size_t _$name$_cached_size_;\n");
         }
@@ -339,7 +721,7 @@ public:
             p.Emit(R"cc(
             {
                 if(::$kun_ns$::HasValue($name$)) {
-                    total_size += ::$kun_ns$::ByteSizeWithTag<$class$, $index$>($name$);
+                    total_size += ::$kun_ns$::ByteSizeWithTag<$class$, $index$>($name$, _sizes_);
                 }
             }
             )cc");
@@ -376,7 +758,7 @@ public:
     {
     }
 
-    void GenerateMembers(Printer& p) const override { p.Emit("std::vector<$type$> $name$;\n"); }
+    void GenerateMembers(Printer& p) const override { p.Emit("$vector$<$type$> $name$;\n"); }
 };
 
 class RepeatedFloatingFieldGenerator : public FieldGeneratorBase
@@ -387,7 +769,14 @@ public:
     {
     }
 
-    void GenerateMembers(Printer& p) const override { p.Emit("std::vector<$type$> $name$;\n"); }
+    void GenerateMembers(Printer& p) const override
+    {
+        if (IsPackedView()) {
+            p.Emit("::kun::PackedView<$type$> $name$;\n");
+        } else {
+            p.Emit("$vector$<$type$> $name$;\n");
+        }
+    }
 };
 
 class RepeatedStringFieldGenerator : public FieldGeneratorBase
@@ -397,17 +786,25 @@ public:
       : FieldGeneratorBase(field, index, options)
     {
     }
-    void GenerateMembers(Printer& p) const override { p.Emit("std::vector<$type$> $name$;\n"); }
+    void GenerateMembers(Printer& p) const override
+    {
+        p.Emit("$vector$<$type$> $name$;\n");
+        if (HasSpare()) {
+            p.Emit("$vector$<$type$> _$name$_spare_;\n");
+        }
+    }
+
+    // string views own nothing
+    bool HasSpare() const override { return options_.spare && !options_.stringView; }
 
     void GenerateDecode(Printer& p) const override
     {
-        p.Emit(R"cc(
-        case __meta__[$index$].tag: {
-            $type$ e;
-            if (!dec.template Decode<$class$, $index$>(e)) {
+        p.Emit({ { "emplace", Emplace() } }, R"cc(
+        case $index$: {
+            if (!dec.template Decode<$class$, $index$>($emplace$)) {
+                $name$.pop_back();
                 return false;
             }
-            $name$.push_back(std::move(e));
             return true;
         }
         )cc");
@@ -422,27 +819,31 @@ public:
     {
     }
 
-    void GenerateMembers(Printer& p) const override { p.Emit("std::vector<$type$> $name$;\n"); }
+    void GenerateMembers(Printer& p) const override
+    {
+        p.Emit("$vector$<$type$> $name$;\n");
+        if (HasSpare()) {
+            p.Emit("$vector$<$type$> _$name$_spare_;\n");
+        }
+    }
+
+    // lazy fields release their objects anyway
+    bool HasSpare() const override { return options_.spare && !IsLazy(field_, options_); }
 
     void GenerateEncode(Printer& p) const override
     {
         p.Emit(R"cc(
-            for (auto & entry : $name$) {
-                enc.template Encode<$class$, $index$>(entry);
-            }
+            enc.template Encode<$class$, $index$>($name$);
             )cc");
     }
 
+    void GenerateEncodeReverse(Printer& p) const override { GenerateEncode(p); }
+
     void GenerateDecode(Printer& p) const override
     {
-        p.Emit(R"cc(
-        case __meta__[$index$].tag: {
-            $type$ e;
-            if (!dec.Decode(e)) {
-                return false;
-            }
-            $name$.push_back(std::move(e));
-            return true;
+        p.Emit({ { "emplace", Emplace() } }, R"cc(
+        case $index$: {
+            return dec.DecodeElement($name$, $emplace$);
         }
         )cc");
     }
@@ -458,7 +859,7 @@ public:
 
     void GenerateMembers(Printer& p) const override
     {
-        p.Emit("std::vector<$type$> $name$;\n");
+        p.Emit("$vector$<$type$> $name$;\n");
         p.Emit("mutable size_t _$name$_cached_size_;\n");
     }
 
@@ -496,11 +897,11 @@ public:
     {
         p.Emit(
           {
-            { "key", GetTypeName(field_->message_type()->map_key()) },
-            { "value", GetTypeName(field_->message_type()->map_value()) },
+            { "key", GetTypeName(field_->message_type()->map_key(), options_) },
+            { "value", GetTypeName(field_->message_type()->map_value(), options_) },
           },
           R"cc(
-              std::unordered_map<$key$, $value$> $name$;
+              $map$<$key$, $value$> $name$;
           )cc");
     }
 };
@@ -515,6 +916,10 @@ public:
     void GenerateMembers(Printer& p) const override {}
 
     void GenerateByteSize(Printer& p) const override {}
+
+    void GenerateParseEntry(Printer& p) const override {}
+
+    void GenerateClear(Printer& p) const override {}
 };
 
 std::unique_ptr<FieldGeneratorBase> MakeGenerator(const FieldDescriptor* field, size_t index, const Options& options)
@@ -548,6 +953,10 @@ std::unique_ptr<FieldGeneratorBase> MakeGenerator(const FieldDescriptor* field,
         return std::make_unique<BooleanFieldGenerator>(field, index, options);
     } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
         return std::make_unique<StringFieldGenerator>(field, index, options);
+    } else if (IsLazy(field, options)) {
+        return std::make_unique<LazyMessageFieldGenerator>(field, index, options);
+    } else if (IsInline(field, options)) {
+        return std::make_unique<InlineMessageFieldGenerator>(field, index, options);
     } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
         return std::make_unique<MessageFieldGenerator>(field, index, options);
     } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM) {
@@ -579,12 +988,30 @@ public:
         impl_->GenerateEncode(p);
     }
 
+    void GenerateEncodeReverse(Printer& p) const
+    {
+        auto v = p.WithVars(MakeVars());
+        impl_->GenerateEncodeReverse(p);
+    }
+
     void GenerateDecode(Printer& p) const
     {
         auto v = p.WithVars(MakeVars());
         impl_->GenerateDecode(p);
     }
 
+    void GenerateParseEntry(Printer& p) const
+    {
+        auto v = p.WithVars(MakeVars());
+        impl_->GenerateParseEntry(p);
+    }
+
+    void GenerateClear(Printer& p) const
+    {
+        auto v = p.WithVars(MakeVars());
+        impl_->GenerateClear(p);
+    }
+
     void GenerateConstructor(Printer& p) const
     {
         auto v = p.WithVars(MakeVars());
@@ -627,6 +1054,24 @@ public:
         impl_->GenerateAssignment(p);
     }
 
+    void GenerateAllocatorConstructor(Printer& p) const
+    {
+        auto v = p.WithVars(MakeVars());
+        impl_->GenerateAllocatorConstructor(p);
+    }
+
+    void GenerateAllocatorCopyConstructor(Printer& p) const
+    {
+        auto v = p.WithVars(MakeVars());
+        impl_->GenerateAllocatorCopyConstructor(p);
+    }
+
+    void GenerateAllocatorMoveConstructor(Printer& p) const
+    {
+        auto v = p.WithVars(MakeVars());
+        impl_->GenerateAllocatorMoveConstructor(p);
+    }
+
     void GenerateMoveAssignment(Printer& p) const
     {
         auto v = p.WithVars(MakeVars());
@@ -639,6 +1084,18 @@ public:
         impl_->GenerateEqual(p);
     }
 
+    void GenerateAccessors(Printer& p) const
+    {
+        auto v = p.WithVars(MakeVars());
+        impl_->GenerateAccessors(p);
+    }
+
+    size_t Alignment() const { return impl_->Alignment(); }
+
+    bool HasBit() const { return impl_->HasBit(); }
+
+    bool BuildsMap() const { return impl_->BuildsMap(); }
+
     std::vector<Printer::Sub> MakeVars() const { return impl_->MakeVars(); }
 
     std::unique_ptr<FieldGeneratorBase> impl_;
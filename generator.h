@@ -5,6 +5,7 @@
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <enum.h>
 #include <message.h>
@@ -15,11 +16,17 @@
 class Generator : public google::protobuf::compiler::CodeGenerator
 {
 public:
+    // proto3 optional fields need presence=bits, which gives them their presence, see CheckFields()
+    uint64_t GetSupportedFeatures() const override { return FEATURE_PROTO3_OPTIONAL; }
+
     bool Generate(const FileDescriptor* file, const std::string& parameter, GeneratorContext* generator_context,
                   std::string* error) const override
     {
 
-        Options options = ParseOptions(parameter);
+        Options options;
+        if (!ParseOptions(parameter, options, error)) {
+            return false;
+        }
 
         std::string basename = google::protobuf::compiler::StripProto(file->name());
 
@@ -38,6 +45,10 @@ public:
         std::vector<const EnumDescriptor*> enumDescs;
         std::vector<const Descriptor*> messageDescs;
         GetAllDescriptor(file, messageDescs, enumDescs);
+        if (!CheckFields(messageDescs, options, error)) {
+            return false;
+        }
+        SortByInline(messageDescs, options);
 
         std::vector<EnumGenerator> enums;
         std::vector<MessageGenerator> messages;
@@ -121,12 +132,146 @@ public:
         }
     }
 
-    Options ParseOptions(const std::string& parameter) const
+    // rejects field options that do not go with the generator options
+    bool CheckFields(const std::vector<const Descriptor*>& messages, const Options& options, std::string* error) const
+    {
+        for (auto desc : messages) {
+            for (int i = 0; i < desc->field_count(); i++) {
+                auto field = desc->field(i);
+                // a Lazy keeps its bytes in a std::string on the global heap
+                if (options.arena && IsLazy(field, options)) {
+                    *error = field->full_name() + ": [lazy = true] can not be used with alloc=arena";
+                    return false;
+                }
+                // without presence bits a proto3 optional field would be a plain field, an explicit zero would be lost
+                if (!options.hasBits && field->containing_oneof() != nullptr &&
+                    field->real_containing_oneof() == nullptr) {
+                    *error = field->full_name() + ": proto3 optional fields need presence=bits";
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // message=inline: a ::kun::Inline member needs the complete type, so the types of inline sub-messages are defined
+    // before the messages that hold them, in file order otherwise
+    void SortByInline(std::vector<const Descriptor*>& messages, const Options& options) const
+    {
+        std::vector<const Descriptor*> sorted;
+        std::unordered_set<const Descriptor*> visited;
+        std::function<void(const Descriptor*)> visit;
+        visit = [&](const Descriptor* desc) {
+            if (!visited.insert(desc).second) {
+                return;
+            }
+            for (int i = 0; i < desc->field_count(); i++) {
+                auto field = desc->field(i);
+                if (IsInline(field, options) && field->message_type()->file() == desc->file()) {
+                    visit(field->message_type());
+                }
+            }
+            sorted.push_back(desc);
+        };
+
+        for (auto desc : messages) {
+            visit(desc);
+        }
+        messages = std::move(sorted);
+    }
+
+    bool ParseOptions(const std::string& parameter, Options& options, std::string* error) const
     {
         std::vector<std::pair<std::string, std::string>> file_options;
         google::protobuf::compiler::ParseGeneratorParameter(parameter, &file_options);
-        Options options;
-        // TODO: parse options
-        return options;
+        for (auto& [key, value] : file_options) {
+            if (key == "decode") {
+                if (value != "switch" && value != "table") {
+                    *error = "unknown decode mode: " + value;
+                    return false;
+                }
+                options.tableDecode = (value == "table");
+            } else if (key == "string") {
+                if (value != "std" && value != "view") {
+                    *error = "unknown string type: " + value;
+                    return false;
+                }
+                options.stringView = (value == "view");
+            } else if (key == "packed") {
+                if (value != "std" && value != "view") {
+                    *error = "unknown packed field type: " + value;
+                    return false;
+                }
+                options.packedView = (value == "view");
+            } else if (key == "alloc") {
+                if (value != "std" && value != "arena") {
+                    *error = "unknown allocation mode: " + value;
+                    return false;
+                }
+                options.arena = (value == "arena");
+            } else if (key == "unknown") {
+                if (value != "drop" && value != "view" && value != "copy") {
+                    *error = "unknown mode for unknown fields: " + value;
+                    return false;
+                }
+                options.unknown = value == "view"   ? Options::Unknown::View
+                                  : value == "copy" ? Options::Unknown::Copy
+                                                    : Options::Unknown::Drop;
+            } else if (key == "presence") {
+                if (value != "value" && value != "bits") {
+                    *error = "unknown presence mode: " + value;
+                    return false;
+                }
+                options.hasBits = (value == "bits");
+            } else if (key == "repeated") {
+                options.repeatedContainer = value;
+            } else if (key == "map") {
+                options.mapContainer = (value == "flat") ? "::kun::FlatMap" : value;
+            } else if (key == "container") {
+                auto pos = value.find('=');
+                if (pos == std::string::npos) {
+                    *error = "container is <full field name>=<template>: " + value;
+                    return false;
+                }
+                auto container = value.substr(pos + 1);
+                options.containers[value.substr(0, pos)] = (container == "flat") ? "::kun::FlatMap" : container;
+            } else if (key == "message") {
+                if (value != "ptr" && value != "inline") {
+                    *error = "unknown message field type: " + value;
+                    return false;
+                }
+                options.inlineMessage = (value == "inline");
+            } else if (key == "clear") {
+                if (value != "reset" && value != "spare") {
+                    *error = "unknown clear mode: " + value;
+                    return false;
+                }
+                options.spare = (value == "spare");
+            } else if (key == "inline_message") {
+                options.inlineMessages.insert(value);
+            } else if (key == "table_decode") {
+                options.tableDecodeMessages.insert(value);
+            } else {
+                *error = "unknown option: " + key;
+                return false;
+            }
+        }
+
+        // these fields would allocate from the global heap, and messages in a kun::Arena are never destroyed
+        if (options.arena) {
+            if (options.packedView) {
+                *error = "packed=view can not be used with alloc=arena";
+                return false;
+            }
+            if (options.unknown == Options::Unknown::View) {
+                *error = "unknown=view can not be used with alloc=arena, unknown=copy can";
+                return false;
+            }
+            if (!options.repeatedContainer.empty() || !options.mapContainer.empty() || !options.containers.empty()) {
+                *error = "repeated=, map= and container= can not be used with alloc=arena";
+                return false;
+            }
+        }
+        return true;
     }
 };
\ No newline at end of file
@@ -48,10 +48,13 @@ void GenerateHeader(const FileDescriptor* file, Printer& p)
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <optional>
 #include <array>
+#include <cstddef>
+#include <memory_resource>
 
 #include "kun.h"
 
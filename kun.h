@@ -1,7 +1,21 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <type_traits>
@@ -9,10 +23,14 @@
 #include <utility>
 #include <vector>
 
+#include <simd.h>
+
 #define ALWAYS_INLINE inline //[[clang::always_inline]]
 
 namespace kun {
 
+class Decoder;
+
 template <typename T, typename... Args>
 inline constexpr bool is_one_of = std::disjunction<std::is_same<T, Args>...>::value;
 
@@ -62,8 +80,10 @@ template <typename T>
 inline constexpr bool is_primitive_v = is_primitive<T>::value;
 
 // string
+// std::string_view for messages generated with string=view, they point into the decoded buffer
+// std::pmr::string for messages generated with alloc=arena
 template <typename T>
-struct is_string : std::integral_constant<bool, std::is_same_v<T, std::string>>
+struct is_string : std::integral_constant<bool, is_one_of<T, std::string, std::string_view, std::pmr::string>>
 {
 };
 
@@ -79,6 +99,11 @@ struct is_message : std::false_type
 template <typename T>
 inline constexpr bool is_message_v = is_message<T>::value;
 
+// Messages generated with string=view, packed=view or unknown=view, or holding such sub-messages, point into the
+// buffer they were decoded from, which the caller keeps alive.
+template <typename T>
+inline constexpr bool views_buffer_v = requires { requires T::__views__; };
+
 // sigular
 template <typename T>
 struct is_sigular : std::disjunction<std::disjunction<is_primitive<T>, is_string<T>, is_message<T>>>
@@ -89,13 +114,30 @@ template <typename T>
 inline constexpr bool is_sigular_v = is_sigular<T>::value;
 
 // repeated
+// Any container like std::vector holds a repeated field, see the repeated= and container= generator options:
+// elements in order that grow at the back, contiguous unless they are bool. The packed fields are copied in and out
+// of them as one block of memory.
+template <typename C>
+concept RepeatedContainer = std::ranges::random_access_range<C> && std::ranges::sized_range<C> &&
+  (std::ranges::contiguous_range<C> || std::is_same_v<std::ranges::range_value_t<C>, bool>) &&
+  requires(C& c, const C& cc, size_t n) {
+      typename C::value_type;
+      { cc.empty() } -> std::convertible_to<bool>;
+      cc.rbegin();
+      c.resize(n);
+      c.emplace_back();
+      c.back();
+      c.pop_back();
+      c.clear();
+  };
+
 template <typename T>
 struct is_repeated : std::false_type
 {
 };
 
-template <typename T>
-struct is_repeated<std::vector<T>> : std::disjunction<is_sigular<T>>
+template <RepeatedContainer C>
+struct is_repeated<C> : std::disjunction<is_sigular<typename C::value_type>>
 {
 };
 
@@ -103,14 +145,26 @@ template <typename T>
 inline constexpr bool is_repeated_v = is_repeated<T>::value;
 
 // map
+// Any container like std::unordered_map holds a map field, see the map= and container= generator options: iterates
+// over std::pair<const K, V> and takes decoded entries through emplace(std::pair<K, V>&&).
+template <typename C>
+concept MapContainer = std::ranges::forward_range<C> && requires(C& c, const C& cc) {
+    typename C::key_type;
+    typename C::mapped_type;
+    { cc.empty() } -> std::convertible_to<bool>;
+    c.emplace(std::declval<std::pair<typename C::key_type, typename C::mapped_type>>());
+    c.clear();
+};
+
 template <typename T>
 struct is_map : std::false_type
 {
 };
 
-template <typename K, typename V>
-struct is_map<std::unordered_map<K, V>>
-  : std::conjunction<std::disjunction<is_primitive<K>, is_string<K>>, is_sigular<V>>
+template <MapContainer C>
+struct is_map<C>
+  : std::conjunction<std::disjunction<is_primitive<typename C::key_type>, is_string<typename C::key_type>>,
+                     is_sigular<typename C::mapped_type>>
 {
 };
 
@@ -142,6 +196,94 @@ struct FieldMeta
     std::string_view name;
 };
 
+// Fields in the order encoders write them (by number), used by generated decoders to guess the next tag.
+template <size_t N>
+struct FieldOrder
+{
+    // tags[N] is 0, which no field has
+    std::array<uint64_t, N + 1> tags;
+    // next[i] follows field i, next[N] is the first field
+    std::array<uint32_t, N + 1> next;
+};
+
+template <size_t N>
+inline constexpr FieldOrder<N> MakeFieldOrder(const std::array<FieldMeta, N>& meta)
+{
+    std::array<uint32_t, N> sorted{};
+    for (uint32_t i = 0; i < N; i++) {
+        sorted[i] = i;
+    }
+    std::ranges::sort(sorted, {}, [&](uint32_t i) { return meta[i].number; });
+
+    FieldOrder<N> order{};
+    for (size_t i = 0; i < N; i++) {
+        order.tags[i] = meta[i].tag;
+    }
+    order.tags[N] = 0;
+
+    uint32_t prev = N;
+    for (auto i : sorted) {
+        order.next[prev] = i;
+        prev = i;
+    }
+    order.next[prev] = N;
+    return order;
+}
+
+// Presence bits of a message generated with presence=bits, one per field in field number order. Encode and
+// ByteSize only visit the fields whose bit is set, or that are always visited (repeated fields, maps and
+// sub-messages, which have no bit of their own).
+template <size_t N>
+class HasBits
+{
+public:
+    constexpr HasBits() = default;
+
+    constexpr HasBits(std::initializer_list<size_t> bits)
+    {
+        for (auto bit : bits) {
+            Set(bit);
+        }
+    }
+
+    constexpr bool Test(size_t bit) const { return words_[bit / 64] >> (bit % 64) & 1; }
+
+    constexpr void Set(size_t bit) { words_[bit / 64] |= uint64_t(1) << (bit % 64); }
+
+    constexpr void Reset(size_t bit) { words_[bit / 64] &= ~(uint64_t(1) << (bit % 64)); }
+
+    constexpr void clear() { words_ = {}; }
+
+    // fn(bit) for the bits set here or in always, in increasing order
+    template <typename Fn>
+    ALWAYS_INLINE void ForEach(const HasBits& always, Fn&& fn) const
+    {
+        for (size_t i = 0; i < words_.size(); i++) {
+            for (auto word = words_[i] | always.words_[i]; word != 0; word &= word - 1) {
+                fn(i * 64 + std::countr_zero(word));
+            }
+        }
+    }
+
+    // fn(bit) for the bits set here or in always, in decreasing order
+    template <typename Fn>
+    ALWAYS_INLINE void ForEachReverse(const HasBits& always, Fn&& fn) const
+    {
+        for (size_t i = words_.size(); i-- > 0;) {
+            for (auto word = words_[i] | always.words_[i]; word != 0;) {
+                auto bit = 63 - std::countl_zero(word);
+                word &= ~(uint64_t(1) << bit);
+                fn(i * 64 + bit);
+            }
+        }
+    }
+
+    constexpr bool operator==(const HasBits& other) const = default;
+
+private:
+    std::array<uint64_t, (N + 63) / 64> words_{};
+};
+
 enum WireType : uint32_t
 {
     WIRE_VARINT = 0,
@@ -234,6 +376,21 @@ struct Encoding
     }
 };
 
+// Element type and varint mode used by the batch kernels in simd.h for a packed integer or enum field.
+template <typename T>
+using PackedType = std::conditional_t<is_enum_v<T>, int32_t, T>;
+
+template <uint32_t encoding, typename T>
+inline constexpr simd::VarintMode PackedVarintMode()
+{
+    if constexpr (encoding == ENCODING_ZIGZAG) {
+        return simd::VARINT_ZIGZAG;
+    } else if constexpr (is_enum_v<T> || std::is_same_v<T, int32_t>) {
+        return simd::VARINT_SIGN_EXTEND;
+    }
+    return simd::VARINT_UNSIGNED;
+}
+
 inline constexpr size_t TagSize(uint64_t tag)
 {
     return Encoding<>::EncodedSize(tag);
@@ -269,14 +426,24 @@ struct MapEntry
     std::pair<K, V>& entry_;
 };
 
+struct ParallelSizes;
+
 template <typename Msg, int index, typename T>
-inline size_t ByteSizeWithTag(const T& value);
+inline size_t ByteSizeWithTag(const T& value, ParallelSizes* sizes = nullptr);
 
 template <typename K, typename V, uint32_t encoding>
 struct ConstMapEntry
 {
     using ThisType = ConstMapEntry<K, V, encoding>;
 
+    // an entry of any map container, std::pair<const K, V> or std::pair<K, V>
+    template <typename Entry>
+    ConstMapEntry(const Entry& entry)
+      : key_(entry.first)
+      , value_(entry.second)
+    {
+    }
+
     inline constexpr static std::array<FieldMeta, 2> __meta__ = {
         FieldMeta{ 1, MakeTag<1, (encoding >> 8), K>(), encoding >> 8, "key" },
         FieldMeta{ 2, MakeTag<2, (encoding & 0xFF), V>(), encoding & 0xFF, "value" },
@@ -285,18 +452,26 @@ struct ConstMapEntry
     template <typename Encoder>
     inline void Encode(Encoder& enc) const
     {
-        enc.template Encode<ThisType, 0>(entry_.first);
-        enc.template Encode<ThisType, 1>(entry_.second);
+        enc.template Encode<ThisType, 0>(key_);
+        enc.template Encode<ThisType, 1>(value_);
+    }
+
+    template <typename Encoder>
+    inline void EncodeReverse(Encoder& enc) const
+    {
+        enc.template Encode<ThisType, 1>(value_);
+        enc.template Encode<ThisType, 0>(key_);
     }
 
     inline size_t ByteSize() const
     {
         //_cached_size_ =
-        return ::kun::ByteSizeWithTag<ThisType, 0>(entry_.first) + ::kun::ByteSizeWithTag<ThisType, 0>(entry_.second);
+        return ::kun::ByteSizeWithTag<ThisType, 0>(key_) + ::kun::ByteSizeWithTag<ThisType, 1>(value_);
         // return _cached_size_;
     }
 
-    const std::pair<const K, V>& entry_;
+    const K& key_;
+    const V& value_;
 
     // mutable size_t _cached_size_;
 };
@@ -311,113 +486,1478 @@ struct is_message<ConstMapEntry<K, V, encoding>> : std::true_type
 {
 };
 
+// A sub-message field marked [lazy = true]. Decoding only keeps a copy of its bytes, they are parsed on first
+// access. Until then the encoders write the kept bytes back unchanged.
+//
+// The first access parses even through a const Lazy, so it is not safe to read an unparsed field from several
+// threads at once. Call Parse() before sharing the message, or guard the first access.
 template <typename T>
-// requires(is_valid_v<T>)
-inline bool HasValue(const T& value)
+class Lazy
 {
-    if constexpr (is_integral_v<T>) {
-        return value != 0;
-    } else if constexpr (is_boolean_v<T>) {
-        return value;
-    } else if constexpr (is_enum_v<T>) {
-        return static_cast<int32_t>(value) != 0;
-    } else if constexpr (is_floating_point_v<T>) {
-        if constexpr (sizeof(T) == 8) {
-            return *reinterpret_cast<const uint64_t*>(&value) != 0;
-        } else if constexpr (sizeof(T) == 4) {
-            return *reinterpret_cast<const uint32_t*>(&value) != 0;
+public:
+    Lazy()
+      : set_(false)
+      , _cached_size_(0)
+    {
+    }
+
+    Lazy(const Lazy& other)
+      : value_(other.value_ ? std::make_unique<T>(*other.value_) : nullptr)
+      , raw_(other.raw_)
+      , set_(other.set_)
+      , _cached_size_(0)
+    {
+    }
+
+    Lazy(Lazy&& other) = default;
+
+    Lazy& operator=(const Lazy& other)
+    {
+        value_ = other.value_ ? std::make_unique<T>(*other.value_) : nullptr;
+        raw_ = other.raw_;
+        set_ = other.set_;
+        return *this;
+    }
+
+    Lazy& operator=(Lazy&& other) = default;
+
+    bool operator==(const Lazy& other) const
+    {
+        if (set_ != other.set_) {
+            return false;
         }
-    } else if constexpr (is_string_v<T>) {
-        return !value.empty();
-    } else if constexpr (is_message_v<T>) {
-        return value.ByteSize() != 0;
-    } else if constexpr (is_repeated_v<T>) {
-        return !value.empty();
-    } else if constexpr (is_map_v<T>) {
-        return !value.empty();
+        if (!set_ || (!Parsed() && !other.Parsed() && raw_ == other.raw_)) {
+            return true;
+        }
+        auto x = get();
+        auto y = other.get();
+        return x != nullptr && y != nullptr && *x == *y;
     }
-    std::unreachable();
-}
 
-template <uint32_t encoding, typename T>
-//    requires(is_valid_v<T>)
-inline size_t ByteSize(const T& value)
+    explicit operator bool() const { return set_; }
+
+    // Parses the kept bytes if that has not happened yet. Returns false if they do not decode, check it before
+    // dereferencing a field from untrusted input.
+    template <typename Decoder = ::kun::Decoder>
+    bool Parse() const
+    {
+        if (value_ || !set_) {
+            return true;
+        }
+
+        auto value = std::make_unique<T>();
+        Decoder dec(reinterpret_cast<const uint8_t*>(raw_.data()), raw_.size());
+        if (!dec.Decode(*value)) {
+            return false;
+        }
+        value_ = std::move(value);
+        raw_ = std::string{};
+        return true;
+    }
+
+    // nullptr if the field is not set or does not decode
+    T* get() { return Parse() ? value_.get() : nullptr; }
+
+    const T* get() const { return Parse() ? value_.get() : nullptr; }
+
+    // throw std::runtime_error if the field is set but does not decode
+    T& operator*() { return *Checked(); }
+
+    const T& operator*() const { return *Checked(); }
+
+    T* operator->() { return Checked(); }
+
+    const T* operator->() const { return Checked(); }
+
+    T& emplace()
+    {
+        value_ = std::make_unique<T>();
+        raw_ = std::string{};
+        set_ = true;
+        return *value_;
+    }
+
+    void reset()
+    {
+        value_.reset();
+        raw_ = std::string{};
+        set_ = false;
+    }
+
+    bool Parsed() const { return value_ != nullptr; }
+
+    // the encoded message while it is not parsed
+    std::string_view Raw() const { return raw_; }
+
+    void Assign(const uint8_t* data, size_t size)
+    {
+        value_.reset();
+        raw_.assign(reinterpret_cast<const char*>(data), size);
+        set_ = true;
+    }
+
+    size_t ByteSize() const
+    {
+        _cached_size_ = value_ ? value_->ByteSize() : raw_.size();
+        return _cached_size_;
+    }
+
+private:
+    T* Checked() const
+    {
+        if (!Parse()) {
+            throw std::runtime_error("kun::Lazy: sub-message does not decode");
+        }
+        return value_.get();
+    }
+
+    mutable std::unique_ptr<T> value_;
+    mutable std::string raw_;
+    bool set_;
+
+public:
+    mutable size_t _cached_size_;
+};
+
+template <typename T>
+struct is_lazy : std::false_type
 {
-    if constexpr (is_boolean_v<T>) {
-        return 1;
-    } else if constexpr (is_integral_v<T>) {
-        return Encoding<encoding>::EncodedSize(value);
-    } else if constexpr (is_enum_v<T>) {
-        return Encoding<encoding>::EncodedSize(value);
-    } else if constexpr (is_floating_point_v<T>) {
-        return sizeof(T);
-    } else if constexpr (is_string_v<T>) {
-        return value.size();
-    } else if constexpr (is_message_v<T>) {
-        return value.ByteSize();
-    } else if constexpr (is_repeated_v<T>) {
-        using EntryType = typename T::value_type;
-        if constexpr (is_boolean_v<EntryType>) {
-            return value.size();
-        } else if constexpr (is_floating_point_v<EntryType>) {
-            return sizeof(EntryType) * value.size();
-        } else if constexpr (is_integral_v<EntryType>) {
-            if constexpr (encoding == ENCODING_FIXED) {
-                return sizeof(EntryType) * value.size();
-            } else {
-                size_t size = 0;
-                for (auto v : value) {
-                    size += Encoding<encoding>::EncodedSize(v);
-                }
-                return size;
-            }
-        } else if constexpr (is_enum_v<EntryType>) {
-            size_t size = 0;
-            for (auto v : value) {
-                size += Encoding<encoding>::EncodedSize(v);
-            }
-            return size;
+};
+
+template <typename T>
+struct is_lazy<Lazy<T>> : std::true_type
+{
+};
+
+template <typename T>
+inline constexpr bool is_lazy_v = is_lazy<T>::value;
+
+template <typename T>
+struct is_message<Lazy<T>> : is_message<T>
+{
+};
+
+// A singular sub-message held by value, see message=inline. Like std::optional, but reset() keeps the sub-message
+// and clears it in place, so its strings and containers keep their capacity for the next decode.
+template <typename T>
+class Inline
+{
+public:
+    bool operator==(const Inline& other) const { return set_ == other.set_ && (!set_ || value_ == other.value_); }
+
+    explicit operator bool() const { return set_; }
+
+    bool has_value() const { return set_; }
+
+    T& operator*() { return value_; }
+
+    const T& operator*() const { return value_; }
+
+    T* operator->() { return &value_; }
+
+    const T* operator->() const { return &value_; }
+
+    T& value()
+    {
+        if (!set_) {
+            throw std::bad_optional_access{};
         }
+        return value_;
     }
 
-    std::unreachable();
-}
+    const T& value() const
+    {
+        if (!set_) {
+            throw std::bad_optional_access{};
+        }
+        return value_;
+    }
 
-template <class Msg, int index, typename T>
-// requires(is_valid_v<T>)
-inline size_t ByteSizeWithTag(const T& value)
+    // sets the field to an empty sub-message
+    T& emplace()
+    {
+        if (set_) {
+            value_.Clear();
+        }
+        set_ = true;
+        return value_;
+    }
+
+    void reset()
+    {
+        if (set_) {
+            value_.Clear();
+            set_ = false;
+        }
+    }
+
+private:
+    // cleared while the field is not set
+    T value_{};
+    bool set_ = false;
+};
+
+// A singular sub-message of a message generated with alloc=arena. Owns the sub-message like std::unique_ptr, but
+// creates it with the allocator of the parent message, so the sub-message lives in the same arena.
+template <typename T>
+class ArenaPtr
 {
-    constexpr auto meta = Msg::__meta__[index];
-    constexpr auto tag = meta.tag;
-    constexpr auto encoding = meta.encoding;
-    if constexpr (is_primitive_v<T>) {
-        return TagSize(tag) + ByteSize<encoding>(value);
-    } else if constexpr (is_string_v<T> || is_message_v<T>) {
-        return TagSize(tag) + LengthDelimitedSize(ByteSize<encoding>(value));
-    } else if constexpr (is_repeated_v<T>) {
-        using EntryType = typename T::value_type;
-        if constexpr (is_primitive_v<EntryType>) {
-            auto size = ByteSize<encoding>(value);
-            return TagSize(tag) + LengthDelimitedSize(size);
-        } else if constexpr (is_string_v<EntryType> || is_message_v<EntryType>) {
-            size_t size = 0;
-            for (auto& entry : value) {
-                size += TagSize(tag) + LengthDelimitedSize(ByteSize<encoding>(entry));
-            }
-            return size;
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+    using element_type = T;
+
+    ArenaPtr()
+      : value_(nullptr)
+    {
+    }
+
+    explicit ArenaPtr(const allocator_type& alloc)
+      : alloc_(alloc)
+      , value_(nullptr)
+    {
+    }
+
+    ArenaPtr(const ArenaPtr& other, const allocator_type& alloc = {})
+      : alloc_(alloc)
+      , value_(nullptr)
+    {
+        if (other) {
+            emplace(*other);
         }
-    } else if constexpr (is_map_v<T>) {
-        using KeyType = typename T::key_type;
-        using ValueType = typename T::mapped_type;
-        size_t size = 0;
-        for (auto& entry : value) {
-            ConstMapEntry<KeyType, ValueType, encoding> e{ entry };
-            size += TagSize(tag) + LengthDelimitedSize(ByteSize<encoding>(e));
+    }
+
+    ArenaPtr(ArenaPtr&& other) noexcept
+      : alloc_(other.alloc_)
+      , value_(std::exchange(other.value_, nullptr))
+    {
+    }
+
+    ArenaPtr(ArenaPtr&& other, const allocator_type& alloc)
+      : alloc_(alloc)
+      , value_(nullptr)
+    {
+        *this = std::move(other);
+    }
+
+    ~ArenaPtr() { reset(); }
+
+    ArenaPtr& operator=(const ArenaPtr& other)
+    {
+        if (this == &other) {
+            return *this;
         }
-        return size;
+        if (!other) {
+            reset();
+        } else if (value_) {
+            *value_ = *other;
+        } else {
+            emplace(*other);
+        }
+        return *this;
     }
 
-    std::unreachable();
+    // like the std::pmr containers, a sub-message from another arena is moved by copying it into this one
+    ArenaPtr& operator=(ArenaPtr&& other)
+    {
+        if (this == &other) {
+            return *this;
+        }
+        if (alloc_ == other.alloc_) {
+            reset();
+            value_ = std::exchange(other.value_, nullptr);
+        } else if (!other) {
+            reset();
+        } else if (value_) {
+            *value_ = std::move(*other);
+        } else {
+            emplace(std::move(*other));
+        }
+        return *this;
+    }
+
+    bool operator==(std::nullptr_t) const { return value_ == nullptr; }
+
+    explicit operator bool() const { return value_ != nullptr; }
+
+    T* get() const { return value_; }
+
+    T& operator*() const { return *value_; }
+
+    T* operator->() const { return value_; }
+
+    template <typename... Args>
+    T& emplace(Args&&... args)
+    {
+        reset();
+        value_ = alloc_.template new_object<T>(std::forward<Args>(args)...);
+        return *value_;
+    }
+
+    void reset()
+    {
+        if (value_) {
+            alloc_.delete_object(value_);
+            value_ = nullptr;
+        }
+    }
+
+    allocator_type get_allocator() const { return alloc_; }
+
+private:
+    allocator_type alloc_;
+    T* value_;
+};
+
+// Memory for request-scoped messages generated with alloc=arena. A message created here allocates its strings,
+// containers, sub-messages and unknown=copy fields from a few large blocks, and all of them are released at once
+// when the arena goes away. The generator rejects the options whose fields would allocate elsewhere, so messages
+// created by Create() do not need to be destroyed.
+class Arena
+{
+public:
+    Arena() = default;
+
+    explicit Arena(size_t initialSize, std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+      : resource_(initialSize, upstream)
+    {
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template <typename T, typename... Args>
+    T* Create(Args&&... args)
+    {
+        return std::pmr::polymorphic_allocator<>(&resource_).new_object<T>(std::forward<Args>(args)...);
+    }
+
+    std::pmr::memory_resource* Resource() { return &resource_; }
+
+private:
+    std::pmr::monotonic_buffer_resource resource_;
+};
+
+// Fields a message generated with unknown=view or unknown=copy does not know. Decoding keeps them, whole fields
+// with their tags, and encoding writes them back after the known fields, so a message from a newer schema passes
+// through unchanged. With String = std::string_view they are ranges into the decoded buffer, which the caller keeps
+// alive; otherwise they are copied into one String.
+template <typename String>
+class UnknownFields
+{
+    static constexpr bool view = std::is_same_v<String, std::string_view>;
+
+public:
+    UnknownFields() = default;
+
+    // alloc=arena: the copy is made with the allocator of the message
+    template <typename Alloc>
+        requires(!view && std::is_constructible_v<String, const Alloc&>)
+    explicit UnknownFields(const Alloc& alloc)
+      : data_(alloc)
+    {
+    }
+
+    template <typename Alloc>
+        requires(!view && std::is_constructible_v<String, const String&, const Alloc&>)
+    UnknownFields(const UnknownFields& other, const Alloc& alloc)
+      : data_(other.data_, alloc)
+    {
+    }
+
+    template <typename Alloc>
+        requires(!view && std::is_constructible_v<String, String&&, const Alloc&>)
+    UnknownFields(UnknownFields&& other, const Alloc& alloc)
+      : data_(std::move(other.data_), alloc)
+    {
+    }
+
+    void Add(const uint8_t* data, size_t size)
+    {
+        auto p = reinterpret_cast<const char*>(data);
+        if constexpr (view) {
+            // unknown fields next to each other on the wire are written back with one copy
+            if (!data_.empty() && data_.back().data() + data_.back().size() == p) {
+                data_.back() = { data_.back().data(), data_.back().size() + size };
+            } else {
+                data_.emplace_back(p, size);
+            }
+        } else {
+            data_.append(p, size);
+        }
+    }
+
+    // the encoded fields, in the order they were decoded
+    auto Ranges() const
+    {
+        if constexpr (view) {
+            return std::span<const std::string_view>(data_);
+        } else {
+            return std::array<std::string_view, 1>{ std::string_view(data_) };
+        }
+    }
+
+    size_t ByteSize() const
+    {
+        size_t size = 0;
+        for (auto range : Ranges()) {
+            size += range.size();
+        }
+        return size;
+    }
+
+    bool empty() const { return data_.empty(); }
+
+    void clear() { data_.clear(); }
+
+private:
+    std::conditional_t<view, std::vector<std::string_view>, String> data_;
+};
+
+template <typename T>
+struct is_unknown_fields : std::false_type
+{
+};
+
+template <typename String>
+struct is_unknown_fields<UnknownFields<String>> : std::true_type
+{
+};
+
+template <typename T>
+inline constexpr bool is_unknown_fields_v = is_unknown_fields<T>::value;
+
+// A repeated fixed32, fixed64, sfixed32, sfixed64, float or double field of a message generated with packed=view.
+// Decoding points it at the packed payload in the input, which the caller keeps alive, when the host is
+// little-endian and the payload is aligned for T. Otherwise, and when the field is split over several records or
+// built by hand, it holds a copy.
+template <typename T>
+class PackedView
+{
+public:
+    using value_type = T;
+    using iterator = const T*;
+    using const_iterator = const T*;
+
+    PackedView() = default;
+
+    PackedView(std::initializer_list<T> values)
+      : copy_(values)
+    {
+        view_ = copy_;
+    }
+
+    PackedView(std::vector<T> values)
+      : copy_(std::move(values))
+    {
+        view_ = copy_;
+    }
+
+    PackedView(const PackedView& other)
+      : view_(other.view_)
+      , copy_(other.copy_)
+    {
+        if (other.Owned()) {
+            view_ = copy_;
+        }
+    }
+
+    // the copy keeps its buffer, so the view stays valid
+    PackedView(PackedView&& other) noexcept
+      : view_(std::exchange(other.view_, {}))
+      , copy_(std::move(other.copy_))
+    {
+    }
+
+    PackedView& operator=(const PackedView& other)
+    {
+        copy_ = other.copy_;
+        view_ = other.Owned() ? std::span<const T>(copy_) : other.view_;
+        return *this;
+    }
+
+    PackedView& operator=(PackedView&& other) noexcept
+    {
+        copy_ = std::move(other.copy_);
+        view_ = std::exchange(other.view_, {});
+        return *this;
+    }
+
+    bool operator==(const PackedView& other) const { return std::ranges::equal(view_, other.view_); }
+
+    // Appends size bytes of little-endian elements, pointing at them if nothing is held yet.
+    void Append(const uint8_t* data, size_t size)
+    {
+        auto n = size / sizeof(T);
+        if constexpr (std::endian::native == std::endian::little) {
+            if (view_.empty() && reinterpret_cast<uintptr_t>(data) % alignof(T) == 0) {
+                copy_.clear();
+                view_ = { reinterpret_cast<const T*>(data), n };
+                return;
+            }
+        }
+
+        if (!Owned()) {
+            copy_.assign(view_.begin(), view_.end());
+        }
+        auto offset = copy_.size();
+        copy_.resize(offset + n);
+        if constexpr (std::endian::native == std::endian::big) {
+            for (size_t i = 0; i < n; i++) {
+                T v;
+                std::memcpy(&v, data + i * sizeof(T), sizeof(T));
+                copy_[offset + i] = std::byteswap(v);
+            }
+        } else {
+            std::memcpy(copy_.data() + offset, data, size);
+        }
+        view_ = copy_;
+    }
+
+    const T* data() const { return view_.data(); }
+    size_t size() const { return view_.size(); }
+    bool empty() const { return view_.empty(); }
+    const T* begin() const { return view_.data(); }
+    const T* end() const { return view_.data() + view_.size(); }
+    const T& operator[](size_t i) const { return view_[i]; }
+
+    // the copy keeps its capacity
+    void clear()
+    {
+        view_ = {};
+        copy_.clear();
+    }
+
+private:
+    // a view into the input leaves the copy empty
+    bool Owned() const { return !copy_.empty(); }
+
+    std::span<const T> view_;
+    std::vector<T> copy_;
+};
+
+template <typename T>
+struct is_repeated<PackedView<T>> : is_primitive<T>
+{
+};
+
+// A vector keeping up to N elements in the object itself, allocating only beyond that, for repeated fields that
+// usually hold a few elements: repeated=::kun::SmallVector or container=<full field name>=::kun::SmallVector. Unlike
+// with std::vector, T is complete where the field is declared.
+template <typename T, size_t N = 4, typename Alloc = std::allocator<T>>
+class SmallVector
+{
+    static_assert(N > 0, "use the vector of the allocator for no inline elements");
+
+    using Traits = std::allocator_traits<Alloc>;
+
+public:
+    using value_type = T;
+    using allocator_type = Alloc;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = T&;
+    using const_reference = const T&;
+    using pointer = T*;
+    using const_pointer = const T*;
+    using iterator = T*;
+    using const_iterator = const T*;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    SmallVector() = default;
+
+    explicit SmallVector(const Alloc& alloc)
+      : alloc_(alloc)
+    {
+    }
+
+    SmallVector(std::initializer_list<T> values, const Alloc& alloc = {})
+      : alloc_(alloc)
+    {
+        assign(values.begin(), values.end());
+    }
+
+    SmallVector(const SmallVector& other)
+      : alloc_(Traits::select_on_container_copy_construction(other.alloc_))
+    {
+        assign(other.begin(), other.end());
+    }
+
+    // with the allocator copied the buffer is taken over, or the inline elements are moved: nothing is allocated
+    SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+      : alloc_(other.alloc_)
+    {
+        Take(other);
+    }
+
+    ~SmallVector()
+    {
+        clear();
+        Deallocate();
+    }
+
+    SmallVector& operator=(const SmallVector& other)
+    {
+        if (this != &other) {
+            assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    // allocates when the allocators differ, the allocator of this is kept
+    SmallVector& operator=(SmallVector&& other) noexcept(Traits::is_always_equal::value &&
+                                                         std::is_nothrow_move_constructible_v<T>)
+    {
+        if (this != &other) {
+            clear();
+            Deallocate();
+            Take(other);
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(std::initializer_list<T> values)
+    {
+        assign(values.begin(), values.end());
+        return *this;
+    }
+
+    bool operator==(const SmallVector& other) const { return std::ranges::equal(*this, other); }
+
+    template <typename It>
+    void assign(It first, It last)
+    {
+        clear();
+        reserve(std::distance(first, last));
+        for (; first != last; ++first) {
+            Traits::construct(alloc_, data_ + size_, *first);
+            size_++;
+        }
+    }
+
+    allocator_type get_allocator() const { return alloc_; }
+
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    T& front() { return data_[0]; }
+    const T& front() const { return data_[0]; }
+    T& back() { return data_[size_ - 1]; }
+    const T& back() const { return data_[size_ - 1]; }
+
+    void reserve(size_t n)
+    {
+        if (n <= capacity_) {
+            return;
+        }
+        auto data = Traits::allocate(alloc_, n);
+        MoveTo(data);
+        Destroy(begin(), end());
+        Deallocate();
+        data_ = data;
+        capacity_ = n;
+    }
+
+    // new elements are value-initialized
+    void resize(size_t n)
+    {
+        if (n < size_) {
+            Destroy(begin() + n, end());
+            size_ = n;
+            return;
+        }
+        Grow(n);
+        for (; size_ < n; size_++) {
+            Traits::construct(alloc_, data_ + size_);
+        }
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        Grow(size_ + 1);
+        Traits::construct(alloc_, data_ + size_, std::forward<Args>(args)...);
+        return data_[size_++];
+    }
+
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    void pop_back()
+    {
+        size_--;
+        Traits::destroy(alloc_, data_ + size_);
+    }
+
+    // keeps the capacity
+    void clear()
+    {
+        Destroy(begin(), end());
+        size_ = 0;
+    }
+
+private:
+    // elements are constructed and destroyed through the allocator, as an allocator aware container does
+    void MoveTo(T* out)
+    {
+        for (auto& e : *this) {
+            Traits::construct(alloc_, out++, std::move(e));
+        }
+    }
+
+    void Destroy(T* first, T* last)
+    {
+        for (; first != last; ++first) {
+            Traits::destroy(alloc_, first);
+        }
+    }
+
+    T* Inline() { return reinterpret_cast<T*>(inline_); }
+
+    bool IsInline() const { return capacity_ == N; }
+
+    // doubles, so appending stays amortized constant
+    void Grow(size_t n)
+    {
+        if (n > capacity_) {
+            reserve(std::max(n, capacity_ * 2));
+        }
+    }
+
+    void Deallocate()
+    {
+        if (!IsInline()) {
+            Traits::deallocate(alloc_, data_, capacity_);
+            data_ = Inline();
+            capacity_ = N;
+        }
+    }
+
+    // this is empty and inline; inline elements are moved one by one, a buffer of the same allocator is taken over
+    void Take(SmallVector& other)
+    {
+        if (other.IsInline() || alloc_ != other.alloc_) {
+            reserve(other.size_);
+            for (auto& e : other) {
+                Traits::construct(alloc_, data_ + size_++, std::move(e));
+            }
+            other.clear();
+            return;
+        }
+        data_ = std::exchange(other.data_, other.Inline());
+        size_ = std::exchange(other.size_, 0);
+        capacity_ = std::exchange(other.capacity_, N);
+    }
+
+    T* data_ = Inline();
+    size_t size_ = 0;
+    size_t capacity_ = N;
+    [[no_unique_address]] Alloc alloc_;
+    alignas(T) std::byte inline_[N * sizeof(T)];
+};
+
+// A map field kept as key/value pairs sorted by key, generated with map=flat or container=<full field name>=flat.
+// Decoding appends the entries as they come, and the message sorts them once it is decoded (see BuildMaps() of the
+// generated message), a later entry replacing an earlier one with the same key as in protobuf. Entries that come in
+// key order, as the encoders write a FlatMap, need no sort. Lookups are binary searches, and inserting moves the
+// entries after the new one, so build large maps with Append() and Build(). Lookups and erase() need Build() after
+// Append(), inserting sorts the appended entries in first. Like std::flat_map, the iterators show an entry as a
+// std::pair<const K&, V&>, so the keys that keep it sorted can not be changed through them.
+template <typename K, typename V, typename Alloc = std::allocator<std::pair<K, V>>>
+class FlatMap
+{
+    using Entries = std::vector<std::pair<K, V>, Alloc>;
+
+    template <bool Const>
+    class Iterator
+    {
+        using Base = std::conditional_t<Const, typename Entries::const_iterator, typename Entries::iterator>;
+
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::pair<K, V>;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::pair<const K&, std::conditional_t<Const, const V&, V&>>;
+
+        // it->second of an iterator that is not stored
+        struct pointer
+        {
+            reference entry;
+
+            const reference* operator->() const { return &entry; }
+        };
+
+        Iterator() = default;
+
+        // an iterator converts to a const_iterator
+        template <bool OtherConst>
+            requires(Const && !OtherConst)
+        Iterator(const Iterator<OtherConst>& other)
+          : it_(other.it_)
+        {
+        }
+
+        reference operator*() const { return { it_->first, it_->second }; }
+        pointer operator->() const { return { **this }; }
+        reference operator[](difference_type n) const { return *(*this + n); }
+
+        Iterator& operator++()
+        {
+            ++it_;
+            return *this;
+        }
+
+        Iterator operator++(int) { return Iterator(it_++); }
+
+        Iterator& operator--()
+        {
+            --it_;
+            return *this;
+        }
+
+        Iterator operator--(int) { return Iterator(it_--); }
+
+        Iterator& operator+=(difference_type n)
+        {
+            it_ += n;
+            return *this;
+        }
+
+        Iterator& operator-=(difference_type n)
+        {
+            it_ -= n;
+            return *this;
+        }
+
+        friend Iterator operator+(Iterator it, difference_type n) { return it += n; }
+        friend Iterator operator+(difference_type n, Iterator it) { return it += n; }
+        friend Iterator operator-(Iterator it, difference_type n) { return it -= n; }
+        friend difference_type operator-(const Iterator& a, const Iterator& b) { return a.it_ - b.it_; }
+
+        bool operator==(const Iterator& other) const { return it_ == other.it_; }
+        auto operator<=>(const Iterator& other) const { return it_ <=> other.it_; }
+
+    private:
+        friend class FlatMap;
+
+        explicit Iterator(Base it)
+          : it_(it)
+        {
+        }
+
+        Base it_;
+    };
+
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using allocator_type = Alloc;
+    using size_type = size_t;
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    FlatMap() = default;
+
+    explicit FlatMap(const Alloc& alloc)
+      : entries_(alloc)
+    {
+    }
+
+    FlatMap(std::initializer_list<value_type> entries, const Alloc& alloc = {})
+      : entries_(entries, alloc)
+    {
+        Build();
+    }
+
+    bool operator==(const FlatMap& other) const { return entries_ == other.entries_; }
+
+    allocator_type get_allocator() const { return entries_.get_allocator(); }
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    void reserve(size_t n) { entries_.reserve(n); }
+
+    // keeps the capacity
+    void clear()
+    {
+        entries_.clear();
+        sorted_ = 0;
+    }
+
+    iterator begin() { return iterator(entries_.begin()); }
+    iterator end() { return iterator(entries_.end()); }
+    const_iterator begin() const { return const_iterator(entries_.begin()); }
+    const_iterator end() const { return const_iterator(entries_.end()); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    // keys compare with std::less<>, so a std::string key is found by a std::string_view
+    template <typename Key>
+    iterator find(const Key& key)
+    {
+        auto it = LowerBound(key);
+        return iterator(it != entries_.end() && !std::less<>{}(key, it->first) ? it : entries_.end());
+    }
+
+    template <typename Key>
+    const_iterator find(const Key& key) const
+    {
+        return const_cast<FlatMap*>(this)->find(key);
+    }
+
+    template <typename Key>
+    bool contains(const Key& key) const
+    {
+        return find(key) != end();
+    }
+
+    template <typename Key>
+    size_t count(const Key& key) const
+    {
+        return contains(key);
+    }
+
+    template <typename Key>
+    V& at(const Key& key)
+    {
+        auto it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("kun::FlatMap::at");
+        }
+        return it->second;
+    }
+
+    template <typename Key>
+    const V& at(const Key& key) const
+    {
+        return const_cast<FlatMap*>(this)->at(key);
+    }
+
+    V& operator[](const K& key) { return try_emplace(key).first->second; }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args)
+    {
+        SortAppended();
+        auto it = LowerBound(key);
+        if (it != entries_.end() && !(key < it->first)) {
+            return { iterator(it), false };
+        }
+        it = entries_.emplace(it, std::piecewise_construct, std::forward_as_tuple(key),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+        sorted_++;
+        return { iterator(it), true };
+    }
+
+    // like std::map, an entry already there is kept
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        value_type entry(std::forward<Args>(args)...);
+        SortAppended();
+        auto it = LowerBound(entry.first);
+        if (it != entries_.end() && !(entry.first < it->first)) {
+            return { iterator(it), false };
+        }
+        sorted_++;
+        return { iterator(entries_.insert(it, std::move(entry))), true };
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(const K& key, M&& value)
+    {
+        auto [it, inserted] = try_emplace(key, std::forward<M>(value));
+        if (!inserted) {
+            it->second = std::forward<M>(value);
+        }
+        return { it, inserted };
+    }
+
+    iterator erase(const_iterator it)
+    {
+        assert(sorted_ == entries_.size());
+        sorted_--;
+        return iterator(entries_.erase(it.it_));
+    }
+
+    template <typename Key>
+        requires(!std::is_convertible_v<const Key&, const_iterator>)
+    size_t erase(const Key& key)
+    {
+        auto it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+
+    // Adds entry at the end, out of order until Build().
+    void Append(value_type&& entry) { entries_.push_back(std::move(entry)); }
+
+    // A default entry at the end to decode into, out of order until Build(), see Decoder.
+    value_type& Append() { return entries_.emplace_back(); }
+
+    // Takes out the entry Append() added.
+    void DropLast() { entries_.pop_back(); }
+
+    // Sorts the appended entries in, the last one of those with the same key kept.
+    void Build()
+    {
+        // entries appended in key order, as the encoders write a FlatMap, need no sort
+        auto from = entries_.begin() + (sorted_ == 0 ? 0 : sorted_ - 1);
+        if (std::adjacent_find(from, entries_.end(), [](auto& a, auto& b) { return !(a.first < b.first); }) ==
+            entries_.end()) {
+            sorted_ = entries_.size();
+            return;
+        }
+        // stable, so of the entries with the same key the last appended is last
+        std::ranges::stable_sort(entries_, std::less<>{}, &value_type::first);
+        auto out = entries_.begin();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it + 1 != entries_.end() && !(it->first < (it + 1)->first)) {
+                continue;
+            }
+            if (out != it) {
+                *out = std::move(*it);
+            }
+            ++out;
+        }
+        entries_.erase(out, entries_.end());
+        sorted_ = entries_.size();
+    }
+
+private:
+    // inserting into the sorted entries needs the appended ones sorted in first
+    void SortAppended()
+    {
+        if (sorted_ != entries_.size()) {
+            Build();
+        }
+    }
+
+    // lookups need Build() after Append()
+    template <typename Key>
+    typename Entries::iterator LowerBound(const Key& key)
+    {
+        assert(sorted_ == entries_.size());
+        return std::ranges::lower_bound(entries_, key, std::less<>{}, &value_type::first);
+    }
+
+    Entries entries_;
+    // entries_ up to sorted_ are sorted by key, with no key twice
+    size_t sorted_ = 0;
+};
+
+// Called by the generated BuildMaps() for its map fields, only FlatMap has anything to do.
+template <typename T>
+inline void BuildMap(T& value)
+{
+    if constexpr (requires { value.Build(); }) {
+        value.Build();
+    }
+}
+
+template <typename T>
+// requires(is_valid_v<T>)
+inline bool HasValue(const T& value)
+{
+    if constexpr (is_integral_v<T>) {
+        return value != 0;
+    } else if constexpr (is_boolean_v<T>) {
+        return value;
+    } else if constexpr (is_enum_v<T>) {
+        return static_cast<int32_t>(value) != 0;
+    } else if constexpr (is_floating_point_v<T>) {
+        if constexpr (sizeof(T) == 8) {
+            return *reinterpret_cast<const uint64_t*>(&value) != 0;
+        } else if constexpr (sizeof(T) == 4) {
+            return *reinterpret_cast<const uint32_t*>(&value) != 0;
+        }
+    } else if constexpr (is_string_v<T>) {
+        return !value.empty();
+    } else if constexpr (is_message_v<T>) {
+        return value.ByteSize() != 0;
+    } else if constexpr (is_repeated_v<T>) {
+        return !value.empty();
+    } else if constexpr (is_map_v<T>) {
+        return !value.empty();
+    }
+    std::unreachable();
+}
+
+template <uint32_t encoding, typename T>
+//    requires(is_valid_v<T>)
+inline size_t ByteSize(const T& value)
+{
+    if constexpr (is_boolean_v<T>) {
+        return 1;
+    } else if constexpr (is_integral_v<T>) {
+        return Encoding<encoding>::EncodedSize(value);
+    } else if constexpr (is_enum_v<T>) {
+        return Encoding<encoding>::EncodedSize(value);
+    } else if constexpr (is_floating_point_v<T>) {
+        return sizeof(T);
+    } else if constexpr (is_string_v<T>) {
+        return value.size();
+    } else if constexpr (is_message_v<T>) {
+        return value.ByteSize();
+    } else if constexpr (is_repeated_v<T>) {
+        using EntryType = typename T::value_type;
+        if constexpr (is_boolean_v<EntryType>) {
+            return value.size();
+        } else if constexpr (is_floating_point_v<EntryType>) {
+            return sizeof(EntryType) * value.size();
+        } else if constexpr (is_integral_v<EntryType>) {
+            if constexpr (encoding == ENCODING_FIXED) {
+                return sizeof(EntryType) * value.size();
+            } else {
+                return simd::PackedVarintSize<PackedVarintMode<encoding, EntryType>()>(value.data(), value.size());
+            }
+        } else if constexpr (is_enum_v<EntryType>) {
+            return simd::PackedVarintSize<PackedVarintMode<encoding, EntryType>()>(
+              reinterpret_cast<const PackedType<EntryType>*>(value.data()), value.size());
+        }
+    }
+
+    std::unreachable();
+}
+
+// Passed down by ByteSizeParallel() through the generated ByteSize(). A first pass only collects the elements of
+// the repeated message fields, in chunks, the tasks size the chunks, and a second pass adds them up in the same
+// order.
+struct ParallelSizes
+{
+    static constexpr size_t kChunk = 256;
+
+    struct Chunk
+    {
+        const void* container;
+        size_t begin;
+        size_t end;
+        size_t (*size)(const void* container, size_t begin, size_t end);
+        size_t result;
+    };
+
+    template <uint64_t tag, uint32_t encoding, typename T>
+    size_t Size(const T& value)
+    {
+        if (!collected) {
+            for (size_t i = 0; i < value.size(); i += kChunk) {
+                chunks.push_back({ &value, i, std::min(i + kChunk, value.size()), &SizeChunk<tag, encoding, T>, 0 });
+            }
+            return 0;
+        }
+
+        size_t size = 0;
+        for (; next < chunks.size() && chunks[next].container == &value; next++) {
+            size += chunks[next].result;
+        }
+        return size;
+    }
+
+    template <uint64_t tag, uint32_t encoding, typename T>
+    static size_t SizeChunk(const void* container, size_t begin, size_t end);
+
+    std::vector<Chunk> chunks;
+    size_t next = 0;
+    bool collected = false;
+};
+
+// the generated messages pass sizes on to their fields, map entries and lazy fields are sized without it
+template <typename T>
+inline size_t MessageByteSize(const T& value, ParallelSizes* sizes)
+{
+    if constexpr (requires { value.ByteSize(sizes); }) {
+        return value.ByteSize(sizes);
+    } else {
+        return value.ByteSize();
+    }
+}
+
+template <class Msg, int index, typename T>
+// requires(is_valid_v<T>)
+inline size_t ByteSizeWithTag(const T& value, ParallelSizes* sizes)
+{
+    constexpr auto meta = Msg::__meta__[index];
+    constexpr auto tag = meta.tag;
+    constexpr auto encoding = meta.encoding;
+    if constexpr (is_primitive_v<T>) {
+        return TagSize(tag) + ByteSize<encoding>(value);
+    } else if constexpr (is_string_v<T>) {
+        return TagSize(tag) + LengthDelimitedSize(ByteSize<encoding>(value));
+    } else if constexpr (is_message_v<T>) {
+        return TagSize(tag) + LengthDelimitedSize(MessageByteSize(value, sizes));
+    } else if constexpr (is_repeated_v<T>) {
+        using EntryType = typename T::value_type;
+        if constexpr (is_primitive_v<EntryType>) {
+            auto size = ByteSize<encoding>(value);
+            return TagSize(tag) + LengthDelimitedSize(size);
+        } else if constexpr (is_string_v<EntryType> || is_message_v<EntryType>) {
+            if constexpr (is_message_v<EntryType>) {
+                if (sizes != nullptr) [[unlikely]] {
+                    return sizes->template Size<tag, encoding>(value);
+                }
+            }
+            size_t size = 0;
+            for (auto& entry : value) {
+                size += TagSize(tag) + LengthDelimitedSize(ByteSize<encoding>(entry));
+            }
+            return size;
+        }
+    } else if constexpr (is_map_v<T>) {
+        using KeyType = typename T::key_type;
+        using ValueType = typename T::mapped_type;
+        size_t size = 0;
+        for (const auto& entry : value) {
+            ConstMapEntry<KeyType, ValueType, encoding> e{ entry };
+            size += TagSize(tag) + LengthDelimitedSize(ByteSize<encoding>(e));
+        }
+        return size;
+    }
+
+    std::unreachable();
+}
+
+template <uint64_t tag, uint32_t encoding, typename T>
+size_t ParallelSizes::SizeChunk(const void* container, size_t begin, size_t end)
+{
+    auto& value = *static_cast<const T*>(container);
+    size_t size = 0;
+    for (auto i = begin; i < end; i++) {
+        size += TagSize(tag) + LengthDelimitedSize(ByteSize<encoding>(value[i]));
+    }
+    return size;
+}
+
+// singular sub-messages are held by pointer, or by value in a ::kun::Inline with message=inline
+template <typename T>
+struct is_message_ptr : std::false_type
+{
+};
+
+template <typename T>
+struct is_message_ptr<Inline<T>> : is_message<T>
+{
+};
+
+template <typename T>
+struct is_message_ptr<std::unique_ptr<T>> : is_message<T>
+{
+};
+
+template <typename T>
+struct is_message_ptr<ArenaPtr<T>> : is_message<T>
+{
+};
+
+template <typename T>
+inline constexpr bool is_message_ptr_v = is_message_ptr<T>::value;
+
+// Generated Clear() resets fields through these. Strings and containers keep their capacity.
+template <typename T>
+inline void Clear(T& value)
+{
+    if constexpr (is_primitive_v<T> || std::is_same_v<T, std::string_view>) {
+        value = T{};
+    } else if constexpr (is_lazy_v<T> || is_message_ptr_v<T>) {
+        value.reset();
+    } else if constexpr (is_message_v<T>) {
+        value.Clear();
+    } else {
+        value.clear();
+    }
+}
+
+// With clear=spare, singular sub-messages, repeated messages and repeated strings have a spare member: Clear() moves
+// the cleared objects there, and decoding takes them back instead of allocating new ones.
+template <typename T>
+inline void Clear(T& value, T& spare)
+{
+    if constexpr (is_message_ptr_v<T>) {
+        if (value) {
+            value->Clear();
+            spare = std::move(value);
+        }
+    } else {
+        for (auto& e : value) {
+            Clear(e);
+        }
+        // decoding takes elements from the back, reversed they go back to the positions they had, where their
+        // capacity likely fits again
+        if (spare.empty()) {
+            // both keep their buffers
+            std::swap(value, spare);
+            std::ranges::reverse(spare);
+        } else {
+            std::ranges::move(value | std::views::reverse, std::back_inserter(spare));
+            value.clear();
+        }
+    }
+}
+
+// Like Decoder::Decode, a sub-message that is already set is merged into.
+template <typename T>
+inline auto& EmplaceMessage(T& value, T* spare = nullptr)
+{
+    if (value) {
+        return *value;
+    }
+    if (spare != nullptr && *spare) {
+        value = std::move(*spare);
+    } else if constexpr (requires { value.emplace(); }) {
+        value.emplace();
+    } else {
+        value = std::make_unique<typename T::element_type>();
+    }
+    return *value;
+}
+
+template <typename T>
+inline auto& EmplaceBack(T& value, T& spare)
+{
+    if (spare.empty()) {
+        return value.emplace_back();
+    }
+    value.push_back(std::move(spare.back()));
+    spare.pop_back();
+    return value.back();
+}
+
+// Meta of a single field with the given encoding. Parse tables decode through it, so all fields of one type and
+// encoding share ParseField whatever message they belong to.
+template <uint32_t encoding>
+struct EncodingMeta
+{
+    inline constexpr static std::array<FieldMeta, 1> __meta__ = {
+        FieldMeta{ 0, 0, encoding, "" },
+    };
+};
+
+// spare is the spare member of the field, see Clear(), or nullptr
+template <typename Decoder, typename T, uint32_t encoding>
+inline bool ParseField(Decoder& dec, void* field, void* spare)
+{
+    auto& value = *static_cast<T*>(field);
+    if constexpr (is_message_ptr_v<T>) {
+        return dec.Decode(EmplaceMessage(value, static_cast<T*>(spare)));
+    } else if constexpr (is_repeated_v<T>) {
+        using EntryType = typename T::value_type;
+        if constexpr (is_message_v<EntryType> || is_string_v<EntryType>) {
+            // decoded in place, so the element gets the allocator of the container
+            auto& e = spare != nullptr ? EmplaceBack(value, *static_cast<T*>(spare)) : value.emplace_back();
+            if constexpr (is_message_v<EntryType>) {
+                return dec.DecodeElement(value, e);
+            } else {
+                if (!dec.template Decode<EncodingMeta<encoding>, 0>(e)) {
+                    value.pop_back();
+                    return false;
+                }
+                return true;
+            }
+        } else {
+            return dec.template Decode<EncodingMeta<encoding>, 0>(value);
+        }
+    } else {
+        return dec.template Decode<EncodingMeta<encoding>, 0>(value);
+    }
+}
+
+// A field of a parse table: the handler decodes the payload of tag into its member of the message.
+template <typename Decoder>
+struct ParseEntry
+{
+    uint64_t tag;
+    bool (*parse)(Decoder& dec, void* msg);
+
+    // the handler marks the field present with presence=bits
+    inline bool Parse(Decoder& dec, void* msg) const { return parse(dec, msg); }
+};
+
+// the bit of a parse table entry whose field has no presence bit
+inline constexpr size_t kNoPresenceBit = ~size_t(0);
+
+// The handler of a field, which finds the member and its spare, if any, through member pointers rather than
+// offsets: offsetof is only conditionally supported on classes that are not standard-layout, as the generated ones
+// are with alloc=arena or [lazy = true] fields. With presence=bits it also marks the field present.
+template <typename Decoder, typename Msg, auto member, auto spare, size_t bit, uint32_t encoding>
+inline bool ParseMember(Decoder& dec, void* msg)
+{
+    auto& m = *static_cast<Msg*>(msg);
+    if constexpr (bit != kNoPresenceBit) {
+        m._has_bits_.Set(bit);
+    }
+    using T = std::remove_cvref_t<decltype(m.*member)>;
+    if constexpr (std::is_null_pointer_v<decltype(spare)>) {
+        return ParseField<Decoder, T, encoding>(dec, &(m.*member), nullptr);
+    } else {
+        return ParseField<Decoder, T, encoding>(dec, &(m.*member), &(m.*spare));
+    }
+}
+
+template <typename Decoder, typename Msg, int index, auto member, auto spare = nullptr, size_t bit = kNoPresenceBit>
+inline constexpr ParseEntry<Decoder> MakeParseEntry()
+{
+    constexpr auto meta = Msg::__meta__[index];
+    return { meta.tag, &ParseMember<Decoder, Msg, member, spare, bit, meta.encoding> };
+}
+
+// Generated for messages decoded table-driven (decode=table), entries are sorted by tag.
+template <typename Decoder, size_t N>
+struct ParseTable
+{
+    std::array<ParseEntry<Decoder>, N> entries;
+
+    // Tries the entry after the previous match first, so fields written in tag order need no search.
+    inline const ParseEntry<Decoder>* Find(uint64_t tag, size_t& next) const
+    {
+        if (next < N && entries[next].tag == tag) [[likely]] {
+            return &entries[next++];
+        }
+
+        auto it = std::ranges::lower_bound(entries, tag, {}, &ParseEntry<Decoder>::tag);
+        if (it == entries.end() || it->tag != tag) {
+            return nullptr;
+        }
+        next = it - entries.begin() + 1;
+        return &*it;
+    }
+
+    // next is the cursor of Find, kept by the caller across the fields of one message
+    template <typename Msg>
+    inline bool Decode(Decoder& dec, uint64_t tag, Msg* msg, size_t& next) const
+    {
+        auto entry = Find(tag, next);
+        if (entry == nullptr) {
+            return true;
+        }
+        return entry->Parse(dec, msg);
+    }
+};
+
+template <typename Decoder, size_t N>
+inline constexpr ParseTable<Decoder, N> MakeParseTable(const std::array<ParseEntry<Decoder>, N>& entries)
+{
+    return { entries };
 }
 
 } // namespace kun
\ No newline at end of file
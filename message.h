@@ -1,7 +1,10 @@
 #pragma once
+#include <algorithm>
 #include <cstddef>
+#include <functional>
 #include <memory>
 #include <ranges>
+#include <unordered_set>
 #include <vector>
 
 #include <field.h>
@@ -26,6 +29,19 @@ public:
             auto field = fields[i];
             fields_.push_back(FieldGenerator(field, i, options));
         }
+
+        // fields are written by number like protobuf does, which is also the order decoders expect
+        for (size_t i = 0; i < fields.size(); i++) {
+            order_.push_back(i);
+        }
+        std::ranges::sort(order_, [&](auto x, auto y) { return fields[x]->number() < fields[y]->number(); });
+
+        // members are declared by alignment, so there is padding only after the last one. __meta__ and the encode
+        // order do not depend on it.
+        for (size_t i = 0; i < fields.size(); i++) {
+            layout_.push_back(i);
+        }
+        std::ranges::stable_sort(layout_, std::ranges::greater{}, [&](auto i) { return fields_[i].Alignment(); });
     }
 
     void GenerateForwardDeclare(Printer& p)
@@ -43,13 +59,15 @@ public:
             {
               "fields",
               [&] {
-                  for (auto& field : fields_) {
-                      field.GenerateMembers(p);
+                  for (auto i : layout_) {
+                      fields_[i].GenerateMembers(p);
                   }
               },
             },
             { "funcs", [&] { GenerateFunctions(p); } },
             { "meta", [&] { GenerateMeta(p); } },
+            { "unknown_member", KeepUnknown() ? UnknownType() + " _unknown_fields_;" : "" },
+            { "has_bits_member", options_.hasBits ? HasBitsType() + " _has_bits_;" : "" },
           },
           R"cc(
           class $class$ 
@@ -59,9 +77,10 @@ public:
 
               $funcs$
 
-              $fields$
-
               mutable size_t _cached_size_;
+              $has_bits_member$
+              $unknown_member$
+              $fields$
           };
           )cc");
     }
@@ -74,56 +93,72 @@ public:
             {
               "encode_body",
               [&] {
-                  for (size_t i = 0; i < fields_.size(); i++) {
-                      fields_[i].GenerateEncode(p);
-                      if (i != fields_.size() - 1) {
+                  if (options_.hasBits) {
+                      GenerateVisit(p, "ForEach", &FieldGenerator::GenerateEncode);
+                      return;
+                  }
+                  for (size_t i = 0; i < order_.size(); i++) {
+                      fields_[order_[i]].GenerateEncode(p);
+                      if (i != order_.size() - 1) {
                           p.Print("\n");
                       }
                   }
               },
             },
             {
-              "decode_body",
+              "encode_reverse_body",
               [&] {
-                  for (size_t i = 0; i < fields_.size(); i++) {
-                      fields_[i].GenerateDecode(p);
+                  if (options_.hasBits) {
+                      GenerateVisit(p, "ForEachReverse", &FieldGenerator::GenerateEncodeReverse);
+                      return;
                   }
-              },
-            },
-            {
-              "constructor_body",
-              [&] {
-                  for (size_t i = 0; i < fields_.size(); i++) {
+                  for (size_t i = order_.size(); i-- > 0;) {
+                      fields_[order_[i]].GenerateEncodeReverse(p);
                       if (i != 0) {
-                          p.Print(", ");
+                          p.Print("\n");
                       }
-                      auto& field = fields_[i];
-                      field.GenerateConstructor(p);
                   }
               },
             },
+            { "decode", [&] { GenerateDecode(p); } },
+            { "constructors", [&] { GenerateConstructors(p); } },
+            { "encode_unknown", KeepUnknown() ? "enc.EncodeUnknown(_unknown_fields_);" : "" },
+            { "assign_unknown", KeepUnknown() ? "_unknown_fields_ = other._unknown_fields_;" : "" },
+            { "move_unknown", KeepUnknown() ? "_unknown_fields_ = std::move(other._unknown_fields_);" : "" },
+            { "clear_unknown", KeepUnknown() ? "_unknown_fields_.clear();" : "" },
+            { "bytesize_unknown", KeepUnknown() ? "total_size += _unknown_fields_.ByteSize();" : "" },
+            { "assign_has_bits", options_.hasBits ? "_has_bits_ = other._has_bits_;" : "" },
+            { "clear_has_bits", options_.hasBits ? "_has_bits_.clear();" : "" },
             {
-              "copy_constructor_body",
+              "accessors",
               [&] {
-                  for (size_t i = 0; i < fields_.size(); i++) {
-                      if (i != 0) {
-                          p.Print(", ");
-                      }
-                      auto& field = fields_[i];
-                      field.GenerateCopyConstructor(p);
+                  for (auto& field : fields_) {
+                      field.GenerateAccessors(p);
                   }
               },
             },
             {
-              "move_constructor_body",
+              "build_maps",
               [&] {
-                  for (size_t i = 0; i < fields_.size(); i++) {
-                      if (i != 0) {
-                          p.Print(", ");
-                      }
-                      auto& field = fields_[i];
-                      field.GenerateMoveConstructor(p);
+                  if (std::ranges::none_of(fields_, &FieldGenerator::BuildsMap)) {
+                      return;
                   }
+                  p.Emit({ { "body",
+                             [&] {
+                                 for (auto& field : fields_) {
+                                     if (field.BuildsMap()) {
+                                         auto v = p.WithVars(field.MakeVars());
+                                         p.Emit("::$kun_ns$::BuildMap($name$);\n");
+                                     }
+                                 }
+                             } } },
+                         R"cc(
+                           // called by the decoder once the message is decoded, see ::$kun_ns$::FlatMap
+                           inline void BuildMaps()
+                           {
+                               $body$
+                           }
+                         )cc");
               },
             },
             {
@@ -144,6 +179,14 @@ public:
                   }
               },
             },
+            {
+              "clear_body",
+              [&] {
+                  for (auto& field : fields_) {
+                      field.GenerateClear(p);
+                  }
+              },
+            },
             {
               "equal_body",
               [&] {
@@ -156,6 +199,10 @@ public:
             {
               "bytesize_body",
               [&] {
+                  if (options_.hasBits) {
+                      GenerateVisit(p, "ForEach", &FieldGenerator::GenerateByteSize);
+                      return;
+                  }
                   for (size_t i = 0; i < fields_.size(); i++) {
                       auto& field = fields_[i];
                       field.GenerateByteSize(p);
@@ -165,31 +212,21 @@ public:
             },
           },
           R"cc(
-            $class$()
-              : $constructor_body$
-              , _cached_size_(0)
-            {
-            }
-
-            $class$(const $class$& other)
-              : $copy_constructor_body$
-            {
-            }
-
-            $class$($class$&& other)
-              : $move_constructor_body$
-            {
-            }
+            $constructors$
 
             $class$& operator=(const $class$& other)
             {
                 $assignment_body$
+                $assign_has_bits$
+                $assign_unknown$
                 return *this;
             }
 
             $class$& operator=($class$&& other)
             {
                 $move_assignment_body$
+                $assign_has_bits$
+                $move_unknown$
                 return *this;
             }
 
@@ -199,32 +236,269 @@ public:
                 return true;
             }
 
+            // Resets every field. Strings and containers keep their capacity for the next decode, and so do
+            // sub-messages with clear=spare, see ::$kun_ns$::Decoder::DecodeReuse().
+            inline void Clear()
+            {
+                $clear_body$
+                $clear_has_bits$
+                $clear_unknown$
+            }
+
+            $accessors$
+
+            $build_maps$
+
             template <typename Encoder>
             inline void Encode(Encoder& enc) const
             {
                 $encode_body$
+                $encode_unknown$
             }
 
-            template <typename Decoder>
-            inline bool Decode(Decoder& dec, uint64_t tag) 
+            // fields in reverse order, for back-to-front encoders
+            template <typename Encoder>
+            inline void EncodeReverse(Encoder& enc) const
             {
-                switch (tag) {
-                $decode_body$
-                }
-
-                return true;
+                $encode_unknown$
+                $encode_reverse_body$
             }
 
-            inline size_t ByteSize() const
+            $decode$
+
+            // _sizes_ is only set by ::$kun_ns$::ByteSizeParallel()
+            inline size_t ByteSize(::$kun_ns$::ParallelSizes* _sizes_ = nullptr) const
             {
                 size_t total_size = 0;
                 $bytesize_body$
+                $bytesize_unknown$
                 _cached_size_ = total_size;
                 return total_size;
             }
             )cc");
     }
 
+    void GenerateConstructors(Printer& p)
+    {
+        // member initializers, one per field in the order of the members
+        auto initializers = [&](void (FieldGenerator::*generate)(Printer&) const) {
+            return [&, generate] {
+                for (auto i : layout_) {
+                    p.Print(", ");
+                    (fields_[i].*generate)(p);
+                }
+            };
+        };
+
+        // the unknown fields member, before the fields
+        auto unknown = [&](const char* init) { return KeepUnknown() ? std::string(", _unknown_fields_") + init : ""; };
+        // the presence bits, before the unknown fields
+        auto bits = [&](const char* init) { return options_.hasBits ? std::string(", _has_bits_") + init : ""; };
+        // a copy of the unknown fields is made with the allocator of the message
+        auto allocator = options_.arena && options_.unknown == Options::Unknown::Copy;
+
+        if (!options_.arena) {
+            p.Emit(
+              {
+                { "constructor_body", initializers(&FieldGenerator::GenerateConstructor) },
+                { "copy_constructor_body", initializers(&FieldGenerator::GenerateCopyConstructor) },
+                { "move_constructor_body", initializers(&FieldGenerator::GenerateMoveConstructor) },
+                { "bits_constructor", bits("()") },
+                { "bits_copy", bits("(other._has_bits_)") },
+                { "unknown_constructor", unknown("()") },
+                { "unknown_copy", unknown("(other._unknown_fields_)") },
+                { "unknown_move", unknown("(std::move(other._unknown_fields_))") },
+              },
+              R"cc(
+                $class$()
+                  : _cached_size_(0)
+                  $bits_constructor$
+                  $unknown_constructor$
+                  $constructor_body$
+                {
+                }
+
+                $class$(const $class$& other)
+                  : _cached_size_(0)
+                  $bits_copy$
+                  $unknown_copy$
+                  $copy_constructor_body$
+                {
+                }
+
+                // noexcept, so vectors of messages move their elements when they grow
+                $class$($class$&& other) noexcept
+                  : _cached_size_(0)
+                  $bits_copy$
+                  $unknown_move$
+                  $move_constructor_body$
+                {
+                }
+                )cc");
+            return;
+        }
+
+        p.Emit(
+          {
+            { "constructor_body", initializers(&FieldGenerator::GenerateAllocatorConstructor) },
+            { "copy_constructor_body", initializers(&FieldGenerator::GenerateAllocatorCopyConstructor) },
+            { "move_constructor_body", initializers(&FieldGenerator::GenerateMoveConstructor) },
+            { "allocator_move_constructor_body", initializers(&FieldGenerator::GenerateAllocatorMoveConstructor) },
+            { "bits_constructor", bits("()") },
+            { "bits_copy", bits("(other._has_bits_)") },
+            { "unknown_constructor", unknown(allocator ? "(alloc)" : "()") },
+            { "unknown_copy", unknown(allocator ? "(other._unknown_fields_, alloc)" : "(other._unknown_fields_)") },
+            { "unknown_move", unknown("(std::move(other._unknown_fields_))") },
+            { "unknown_allocator_move",
+              unknown(allocator ? "(std::move(other._unknown_fields_), alloc)"
+                                : "(std::move(other._unknown_fields_))") },
+          },
+          R"cc(
+            // std::pmr containers of this message, and ArenaPtr, pass their allocator down to it
+            using allocator_type = ::std::pmr::polymorphic_allocator<>;
+
+            $class$()
+              : $class$(allocator_type{})
+            {
+            }
+
+            explicit $class$(const allocator_type& alloc)
+              : _cached_size_(0)
+              $bits_constructor$
+              $unknown_constructor$
+              $constructor_body$
+            {
+            }
+
+            $class$(const $class$& other, const allocator_type& alloc = {})
+              : _cached_size_(0)
+              $bits_copy$
+              $unknown_copy$
+              $copy_constructor_body$
+            {
+            }
+
+            $class$($class$&& other) noexcept
+              : _cached_size_(0)
+              $bits_copy$
+              $unknown_move$
+              $move_constructor_body$
+            {
+            }
+
+            $class$($class$&& other, const allocator_type& alloc)
+              : _cached_size_(0)
+              $bits_copy$
+              $unknown_allocator_move$
+              $allocator_move_constructor_body$
+            {
+            }
+            )cc");
+    }
+
+    void GenerateDecode(Printer& p)
+    {
+        if (!options_.TableDecode(desc_) || fields_.empty()) {
+            p.Emit(
+              {
+                {
+                  "decode_body",
+                  [&] {
+                      for (size_t i = 0; i < fields_.size(); i++) {
+                          fields_[i].GenerateDecode(p);
+                      }
+                  },
+                },
+                {
+                  "index_body",
+                  [&] {
+                      for (size_t i = 0; i < fields_.size(); i++) {
+                          p.Emit({ { "index", i } }, "case __meta__[$index$].tag: return $index$;\n");
+                      }
+                  },
+                },
+              },
+              R"cc(
+                // guesses that the field after the previously decoded one comes next, and only switches on the
+                // tag when it does not
+                template <typename Decoder>
+                inline bool Decode(Decoder& dec, uint64_t tag, uint32_t& last)
+                {
+                    auto index = __order__.next[last];
+                    if (__order__.tags[index] != tag) [[unlikely]] {
+                        // elements of a repeated field repeat the tag
+                        index = __order__.tags[last] == tag ? last : FieldIndex(tag);
+                    }
+                    last = index;
+                    return DecodeField(dec, index);
+                }
+
+                template <typename Decoder>
+                inline bool Decode(Decoder& dec, uint64_t tag)
+                {
+                    return DecodeField(dec, FieldIndex(tag));
+                }
+
+                inline static uint32_t FieldIndex(uint64_t tag)
+                {
+                    switch (tag) {
+                    $index_body$
+                    }
+
+                    return __meta__.size();
+                }
+
+                template <typename Decoder>
+                inline bool DecodeField(Decoder& dec, uint32_t index)
+                {
+                    switch (index) {
+                    $decode_body$
+                    }
+
+                    return true;
+                }
+                )cc");
+            return;
+        }
+
+        p.Emit(
+          {
+            {
+              "parse_entries",
+              [&] {
+                  // the table is searched by tag
+                  for (auto i : order_) {
+                      fields_[i].GenerateParseEntry(p);
+                  }
+              },
+            },
+          },
+          R"cc(
+            // decoders look fields up in this table instead of switching on the tag
+            template <typename Decoder>
+            inline static const auto& __parse_table__()
+            {
+                static constexpr auto table = ::$kun_ns$::MakeParseTable(std::to_array<::$kun_ns$::ParseEntry<Decoder>>({
+                    $parse_entries$
+                }));
+                return table;
+            }
+
+            template <typename Decoder>
+            inline bool Decode(Decoder& dec, uint64_t tag, size_t& next)
+            {
+                return __parse_table__<Decoder>().Decode(dec, tag, this, next);
+            }
+
+            template <typename Decoder>
+            inline bool Decode(Decoder& dec, uint64_t tag)
+            {
+                size_t next = 0;
+                return Decode(dec, tag, next);
+            }
+            )cc");
+    }
+
     void GenerateHelperFunctions(Printer& p) const
     {
         auto v = p.WithVars(MakeVars());
@@ -253,9 +527,62 @@ public:
           R"cc(
            inline constexpr static std::array<::$kun_ns$::FieldMeta, $field_num$> __meta__ = {
                $field_meta$
-           };)cc");
+           };
+
+           inline constexpr static auto __order__ = ::$kun_ns$::MakeFieldOrder(__meta__);)cc");
+
+        if (options_.hasBits) {
+            std::string always;
+            for (size_t bit = 0; bit < order_.size(); bit++) {
+                if (!fields_[order_[bit]].HasBit()) {
+                    always += (always.empty() ? "" : ", ") + std::to_string(bit);
+                }
+            }
+            p.Emit({ { "type", HasBitsType() }, { "always", always } }, R"cc(
+
+              // fields without a presence bit, visited whether set or not
+              inline constexpr static $type$ __always__ = { $always$ };)cc");
+        }
+
+        std::unordered_set<const Descriptor*> visited;
+        if (ViewsBuffer(desc_, options_, visited)) {
+            p.Emit(R"cc(
+
+              // decoded messages point into the decoded buffer, see ::$kun_ns$::views_buffer_v
+              inline constexpr static bool __views__ = true;)cc");
+        }
     }
 
+    // presence=bits: generate(field) for each field in a switch on the bits ForEach or ForEachReverse visits
+    void GenerateVisit(Printer& p, const char* each, void (FieldGenerator::*generate)(Printer&) const) const
+    {
+        p.Emit(
+          {
+            { "each", each },
+            {
+              "cases",
+              [&] {
+                  for (size_t bit = 0; bit < order_.size(); bit++) {
+                      p.Emit({ { "bit", bit }, { "body", [&] { (fields_[order_[bit]].*generate)(p); } } }, R"cc(
+                        case $bit$: {
+                            $body$
+                        } break;
+                      )cc");
+                  }
+              },
+            },
+          },
+          R"cc(
+            _has_bits_.$each$(__always__, [&](size_t bit) {
+                switch (bit) {
+                $cases$
+                }
+            });
+          )cc");
+    }
+
+    std::string HasBitsType() const { return "::kun::HasBits<" + std::to_string(fields_.size()) + ">"; }
+
     std::vector<Printer::Sub> MakeVars() const
     {
         return {
@@ -264,8 +591,24 @@ public:
         };
     }
 
+    bool KeepUnknown() const { return options_.unknown != Options::Unknown::Drop; }
+
+    std::string UnknownType() const
+    {
+        switch (options_.unknown) {
+        case Options::Unknown::View:
+            return "::kun::UnknownFields<std::string_view>";
+        case Options::Unknown::Copy:
+            return options_.arena ? "::kun::UnknownFields<std::pmr::string>" : "::kun::UnknownFields<std::string>";
+        default:
+            return "";
+        }
+    }
+
 private:
     const Descriptor* desc_;
     Options options_;
     std::vector<FieldGenerator> fields_;
+    std::vector<size_t> order_;
+    std::vector<size_t> layout_;
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <protobuf.h>
+
+// Generator options, passed as protoc parameters: --kun_out=decode=table,string=view:out_dir
+struct Options
+{
+    // decode=table: every message of the file decodes through a parse table instead of a switch
+    bool tableDecode = false;
+
+    // table_decode=<full name>, may be repeated: only these messages decode through a parse table
+    std::unordered_set<std::string> tableDecodeMessages;
+
+    // string=view: string/bytes fields, singular and repeated, are std::string_view into the decoded buffer, which
+    // the caller keeps alive. Map keys and values stay std::string.
+    bool stringView = false;
+
+    // packed=view: repeated fixed32, fixed64, sfixed32, sfixed64, float and double fields are ::kun::PackedView, which
+    // points into the decoded buffer instead of copying it when alignment allows. The caller keeps the buffer alive.
+    bool packedView = false;
+
+    // alloc=arena: strings, repeated fields, maps and sub-messages allocate through std::pmr polymorphic allocators
+    // taken from the message, so a message created in a kun::Arena keeps its whole tree there. packed=view,
+    // unknown=view, repeated=, map=, container= and fields marked [lazy = true] would allocate outside the arena,
+    // they are rejected with it.
+    bool arena = false;
+
+    // unknown=view: fields a message does not know are kept in a ::kun::UnknownFields member, as ranges into the
+    // decoded buffer that the caller keeps alive, and written back by Encode. unknown=copy keeps a copy of them.
+    enum class Unknown
+    {
+        Drop,
+        View,
+        Copy,
+    };
+    Unknown unknown = Unknown::Drop;
+
+    // presence=bits: singular scalar and string fields with explicit presence (proto3 optional, oneof members) get a
+    // bit in a ::kun::HasBits member, set by the decoder and by the generated set_<field>() and cleared by
+    // clear_<field>() and Clear(). They are written whenever their bit is set, so assign them through set_<field>().
+    // Fields with implicit presence get no bit and no accessors, they are written when they are not zero as without
+    // presence=bits.
+    bool hasBits = false;
+
+    // repeated=<template>: class template of the repeated fields, message fields aside, instead of std::vector, e.g.
+    // ::kun::SmallVector to keep a few elements inline. map=<template> does the same for map fields, in place of
+    // std::unordered_map. The templates satisfy ::kun::RepeatedContainer or ::kun::MapContainer and their headers are
+    // included before the generated one. container=<full field name>=<template>, may be repeated, sets the template
+    // of one field, repeated message fields too when the element type is complete there. They can not be used with
+    // alloc=arena. Pass them with --kun_opt, as the template names have colons.
+    // map=flat stands for map=::kun::FlatMap, sorted key/value pairs that decoding sorts once per message.
+    std::string repeatedContainer;
+    std::string mapContainer;
+    std::unordered_map<std::string, std::string> containers;
+
+    // message=inline: singular sub-message fields are held by value in ::kun::Inline instead of std::unique_ptr, so
+    // setting one allocates nothing. inline_message=<full field name>, may be repeated, does the same for one field.
+    // Fields whose type can contain the message again, directly or not, stay pointers, as do lazy and oneof fields
+    // and all of them with alloc=arena.
+    bool inlineMessage = false;
+    std::unordered_set<std::string> inlineMessages;
+
+    // clear=spare: pointer sub-message fields, repeated message fields and repeated string fields get a spare member
+    // of the same type. Clear() moves the cleared objects there and decoding takes them back, so a message that is
+    // cleared and decoded again in a loop stops allocating, see ::kun::Decoder::DecodeReuse(). Each such field takes
+    // twice the space, so this is off by default and Clear() frees those objects.
+    bool spare = false;
+
+    bool TableDecode(const Descriptor* desc) const
+    {
+        return tableDecode || tableDecodeMessages.contains(desc->full_name());
+    }
+};
@@ -16,7 +16,6 @@ using google::protobuf::Descriptor;
 using google::protobuf::EnumDescriptor;
 using google::protobuf::FieldDescriptor;
 using google::protobuf::FileDescriptor;
-using google::protobuf::compiler::cpp::Options;
 using google::protobuf::io::Printer;
 using google::protobuf::compiler::cpp::NamespaceOpener;
 
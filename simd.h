@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#    include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#endif
+
+// Batch kernels for packed repeated integers. The vector paths are picked at compile time with -mavx2 or -msse4.1,
+// and counting only needs SSE2. Everything else falls back to the scalar loops, which the vector loops also use
+// for their tails.
+namespace kun::simd {
+
+// How the elements of a packed field turn into varints.
+enum VarintMode
+{
+    VARINT_UNSIGNED = 0, // uint32/uint64, and int64 whose two's complement is the varint value
+    VARINT_SIGN_EXTEND = 1, // int32 and enums: negative values are sign-extended to ten bytes
+    VARINT_ZIGZAG = 2, // sint32/sint64
+};
+
+template <VarintMode mode, typename T>
+inline constexpr auto ToVarint(T v)
+{
+    using U = std::make_unsigned_t<T>;
+    if constexpr (mode == VARINT_ZIGZAG) {
+        return static_cast<U>((static_cast<U>(v) << 1) ^ static_cast<U>(v >> (sizeof(T) * 8 - 1)));
+    } else if constexpr (mode == VARINT_SIGN_EXTEND) {
+        return static_cast<uint64_t>(static_cast<int64_t>(v));
+    } else {
+        return static_cast<U>(v);
+    }
+}
+
+template <typename T>
+inline constexpr size_t VarintSize(T v)
+{
+    return static_cast<size_t>(((std::numeric_limits<T>::digits * 9 + 64) - (std::countl_zero(v) * 9)) / 64);
+}
+
+template <VarintMode mode, typename T>
+inline size_t PackedVarintSizeScalar(const T* data, size_t n)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < n; i++) {
+        size += VarintSize(ToVarint<mode>(data[i]));
+    }
+    return size;
+}
+
+template <VarintMode mode, typename T>
+inline uint8_t* EncodePackedVarintScalar(uint8_t* out, const T* data, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        auto v = ToVarint<mode>(data[i]);
+        while (v >= 0x80) {
+            *out++ = static_cast<uint8_t>(v | 0x80);
+            v >>= 7;
+        }
+        *out++ = static_cast<uint8_t>(v);
+    }
+    return out;
+}
+
+// Number of varints in a packed payload: every varint ends with exactly one byte whose high bit is clear.
+inline size_t CountVarintsScalar(const uint8_t* data, size_t n)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += data[i] < 0x80;
+    }
+    return count;
+}
+
+namespace detail {
+
+// After a block that does not fit the one-byte fast path, this many elements go through the scalar loop before the
+// next block is checked again, so mixed-width data does not pay for the check on every block.
+inline constexpr size_t kScalarRun = 64;
+
+#if defined(__AVX2__)
+
+template <VarintMode mode>
+inline size_t PackedVarintSize32(const uint32_t* data, size_t n, size_t& i)
+{
+    const __m256i t7 = _mm256_set1_epi32(1 << 7);
+    const __m256i t14 = _mm256_set1_epi32(1 << 14);
+    const __m256i t21 = _mm256_set1_epi32(1 << 21);
+    const __m256i t28 = _mm256_set1_epi32(1 << 28);
+
+    size_t size = 0;
+    while (i + 8 <= n) {
+        // bounded so the 32-bit lanes cannot overflow
+        size_t stop = std::min(n, i + (size_t(1) << 24));
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 8 <= stop; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            if constexpr (mode == VARINT_ZIGZAG) {
+                v = _mm256_xor_si256(_mm256_slli_epi32(v, 1), _mm256_srai_epi32(v, 31));
+            }
+            // v >= t  <=>  max(v, t) == v, the mask counts as -1
+            acc = _mm256_sub_epi32(acc, _mm256_cmpeq_epi32(_mm256_max_epu32(v, t7), v));
+            acc = _mm256_sub_epi32(acc, _mm256_cmpeq_epi32(_mm256_max_epu32(v, t14), v));
+            acc = _mm256_sub_epi32(acc, _mm256_cmpeq_epi32(_mm256_max_epu32(v, t21), v));
+            acc = _mm256_sub_epi32(acc, _mm256_cmpeq_epi32(_mm256_max_epu32(v, t28), v));
+            if constexpr (mode == VARINT_SIGN_EXTEND) {
+                acc = _mm256_add_epi32(acc, _mm256_and_si256(_mm256_srai_epi32(v, 31), _mm256_set1_epi32(5)));
+            }
+            acc = _mm256_add_epi32(acc, _mm256_set1_epi32(1));
+        }
+
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+        for (auto lane : lanes) {
+            size += lane;
+        }
+    }
+    return size;
+}
+
+// Stores blocks whose elements all fit in one byte with a single pack; other blocks go through the scalar loop.
+template <VarintMode mode>
+inline uint8_t* EncodePackedVarint32(uint8_t* out, const uint32_t* data, size_t n, size_t& i)
+{
+    const __m256i max = _mm256_set1_epi32(0x7F);
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        if constexpr (mode == VARINT_ZIGZAG) {
+            v = _mm256_xor_si256(_mm256_slli_epi32(v, 1), _mm256_srai_epi32(v, 31));
+        }
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_max_epu32(v, max), max)) != -1) {
+            using T = std::conditional_t<mode == VARINT_UNSIGNED, uint32_t, int32_t>;
+            auto run = std::min(n - i, kScalarRun);
+            out = EncodePackedVarintScalar<mode>(out, reinterpret_cast<const T*>(data + i), run);
+            i += run - 8;
+            continue;
+        }
+        __m256i w = _mm256_packus_epi16(_mm256_packus_epi32(v, v), _mm256_packus_epi32(v, v));
+        uint32_t lo = _mm_cvtsi128_si32(_mm256_castsi256_si128(w));
+        uint32_t hi = _mm_cvtsi128_si32(_mm256_extracti128_si256(w, 1));
+        std::memcpy(out, &lo, 4);
+        std::memcpy(out + 4, &hi, 4);
+        out += 8;
+    }
+    return out;
+}
+
+template <VarintMode mode>
+inline uint8_t* EncodePackedVarint64(uint8_t* out, const uint64_t* data, size_t n, size_t& i)
+{
+    const __m256i sign = _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+    const __m256i limit = _mm256_xor_si256(_mm256_set1_epi64x(0x80), sign);
+    const __m256i gather = _mm256_setr_epi8(0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+                                            0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        if constexpr (mode == VARINT_ZIGZAG) {
+            auto negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(), v);
+            v = _mm256_xor_si256(_mm256_slli_epi64(v, 1), negative);
+        }
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi64(limit, _mm256_xor_si256(v, sign))) != -1) {
+            using T = std::conditional_t<mode == VARINT_ZIGZAG, int64_t, uint64_t>;
+            auto run = std::min(n - i, kScalarRun);
+            out = EncodePackedVarintScalar<mode>(out, reinterpret_cast<const T*>(data + i), run);
+            i += run - 4;
+            continue;
+        }
+        __m256i w = _mm256_shuffle_epi8(v, gather);
+        uint16_t lo = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm256_castsi256_si128(w)));
+        uint16_t hi = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm256_extracti128_si256(w, 1)));
+        std::memcpy(out, &lo, 2);
+        std::memcpy(out + 2, &hi, 2);
+        out += 4;
+    }
+    return out;
+}
+
+inline size_t CountVarints(const uint8_t* data, size_t n, size_t& i)
+{
+    size_t count = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        // movemask collects the continuation bits
+        count += 32 - std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(v)));
+    }
+    return count;
+}
+
+#elif defined(__SSE4_1__)
+
+template <VarintMode mode>
+inline size_t PackedVarintSize32(const uint32_t* data, size_t n, size_t& i)
+{
+    const __m128i t7 = _mm_set1_epi32(1 << 7);
+    const __m128i t14 = _mm_set1_epi32(1 << 14);
+    const __m128i t21 = _mm_set1_epi32(1 << 21);
+    const __m128i t28 = _mm_set1_epi32(1 << 28);
+
+    size_t size = 0;
+    while (i + 4 <= n) {
+        size_t stop = std::min(n, i + (size_t(1) << 24));
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 4 <= stop; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            if constexpr (mode == VARINT_ZIGZAG) {
+                v = _mm_xor_si128(_mm_slli_epi32(v, 1), _mm_srai_epi32(v, 31));
+            }
+            acc = _mm_sub_epi32(acc, _mm_cmpeq_epi32(_mm_max_epu32(v, t7), v));
+            acc = _mm_sub_epi32(acc, _mm_cmpeq_epi32(_mm_max_epu32(v, t14), v));
+            acc = _mm_sub_epi32(acc, _mm_cmpeq_epi32(_mm_max_epu32(v, t21), v));
+            acc = _mm_sub_epi32(acc, _mm_cmpeq_epi32(_mm_max_epu32(v, t28), v));
+            if constexpr (mode == VARINT_SIGN_EXTEND) {
+                acc = _mm_add_epi32(acc, _mm_and_si128(_mm_srai_epi32(v, 31), _mm_set1_epi32(5)));
+            }
+            acc = _mm_add_epi32(acc, _mm_set1_epi32(1));
+        }
+
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        size += size_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+    return size;
+}
+
+template <VarintMode mode>
+inline uint8_t* EncodePackedVarint32(uint8_t* out, const uint32_t* data, size_t n, size_t& i)
+{
+    const __m128i max = _mm_set1_epi32(0x7F);
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if constexpr (mode == VARINT_ZIGZAG) {
+            v = _mm_xor_si128(_mm_slli_epi32(v, 1), _mm_srai_epi32(v, 31));
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_max_epu32(v, max), max)) != 0xFFFF) {
+            using T = std::conditional_t<mode == VARINT_UNSIGNED, uint32_t, int32_t>;
+            auto run = std::min(n - i, kScalarRun);
+            out = EncodePackedVarintScalar<mode>(out, reinterpret_cast<const T*>(data + i), run);
+            i += run - 4;
+            continue;
+        }
+        uint32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(v, v), v));
+        std::memcpy(out, &packed, 4);
+        out += 4;
+    }
+    return out;
+}
+
+#endif
+
+#if !defined(__AVX2__) && (defined(__SSE2__) || defined(_M_X64))
+
+inline size_t CountVarints(const uint8_t* data, size_t n, size_t& i)
+{
+    size_t count = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        count += 16 - std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(v)));
+    }
+    return count;
+}
+
+#endif
+
+} // namespace detail
+
+// Encoded size of all elements of a packed field, without tag and length.
+template <VarintMode mode, typename T>
+inline size_t PackedVarintSize(const T* data, size_t n)
+{
+    static_assert(std::is_integral_v<T>);
+    size_t i = 0;
+    size_t size = 0;
+    if constexpr (sizeof(T) == 4) {
+#if defined(__AVX2__) || defined(__SSE4_1__)
+        size = detail::PackedVarintSize32<mode>(reinterpret_cast<const uint32_t*>(data), n, i);
+#endif
+    }
+    // 64-bit elements stay scalar: without a vector lzcnt the nine compares per lane lose to countl_zero
+    return size + PackedVarintSizeScalar<mode>(data + i, n - i);
+}
+
+// Writes all elements as varints to out, which needs room for ten bytes per element. Returns the new end.
+template <VarintMode mode, typename T>
+inline uint8_t* EncodePackedVarint(uint8_t* out, const T* data, size_t n)
+{
+    static_assert(std::is_integral_v<T>);
+    size_t i = 0;
+    if constexpr (sizeof(T) == 4) {
+#if defined(__AVX2__) || defined(__SSE4_1__)
+        out = detail::EncodePackedVarint32<mode>(out, reinterpret_cast<const uint32_t*>(data), n, i);
+#endif
+    } else {
+#if defined(__AVX2__)
+        out = detail::EncodePackedVarint64<mode>(out, reinterpret_cast<const uint64_t*>(data), n, i);
+#endif
+    }
+    return EncodePackedVarintScalar<mode>(out, data + i, n - i);
+}
+
+// Number of varints in a packed payload, used to size the destination before decoding it.
+inline size_t CountVarints(const uint8_t* data, size_t n)
+{
+    size_t i = 0;
+    size_t count = 0;
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    count = detail::CountVarints(data, n, i);
+#endif
+    return count + CountVarintsScalar(data + i, n - i);
+}
+
+} // namespace kun::simd
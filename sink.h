@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <codec.h>
+
+namespace kun {
+
+// Collects the output in a chain of fixed-size chunks, so a large message never needs one contiguous buffer.
+class ChunkSink
+{
+public:
+    explicit ChunkSink(size_t chunkSize = 64 * 1024)
+      : chunkSize_(chunkSize)
+      , size_(0)
+    {
+    }
+
+    bool Write(const uint8_t* data, size_t size)
+    {
+        while (size > 0) {
+            auto index = size_ / chunkSize_;
+            auto used = size_ % chunkSize_;
+            if (index == chunks_.size()) {
+                chunks_.push_back(std::make_unique_for_overwrite<uint8_t[]>(chunkSize_));
+            }
+
+            auto n = std::min(size, chunkSize_ - used);
+            std::memcpy(chunks_[index].get() + used, data, n);
+            data += n;
+            size -= n;
+            size_ += n;
+        }
+        return true;
+    }
+
+    size_t Size() const { return size_; }
+
+    size_t ChunkCount() const { return (size_ + chunkSize_ - 1) / chunkSize_; }
+
+    std::span<const uint8_t> Chunk(size_t i) const
+    {
+        return { chunks_[i].get(), std::min(chunkSize_, size_ - i * chunkSize_) };
+    }
+
+    // Keeps the allocated chunks for the next message.
+    void Clear() { size_ = 0; }
+
+private:
+    size_t chunkSize_;
+    size_t size_;
+    std::vector<std::unique_ptr<uint8_t[]>> chunks_;
+};
+
+// Adapts a google::protobuf::io::ZeroCopyOutputStream style stream (Next/BackUp). The unused tail of the last
+// buffer is handed back when the sink is destroyed.
+template <typename Stream>
+class ZeroCopySink
+{
+public:
+    explicit ZeroCopySink(Stream& stream)
+      : stream_(stream)
+      , data_(nullptr)
+      , size_(0)
+    {
+    }
+
+    ZeroCopySink(const ZeroCopySink&) = delete;
+
+    ZeroCopySink& operator=(const ZeroCopySink&) = delete;
+
+    ~ZeroCopySink()
+    {
+        if (size_ > 0) {
+            stream_.BackUp(size_);
+        }
+    }
+
+    bool Write(const uint8_t* data, size_t size)
+    {
+        while (size > 0) {
+            if (size_ == 0) {
+                void* next;
+                if (!stream_.Next(&next, &size_)) {
+                    size_ = 0;
+                    return false;
+                }
+                data_ = static_cast<uint8_t*>(next);
+                continue;
+            }
+
+            auto n = std::min(size, static_cast<size_t>(size_));
+            std::memcpy(data_, data, n);
+            data += n;
+            size -= n;
+            data_ += n;
+            size_ -= static_cast<int>(n);
+        }
+        return true;
+    }
+
+private:
+    Stream& stream_;
+    uint8_t* data_;
+    int size_;
+};
+
+// Produces an iovec list for writev/sendmsg. Tag/length headers and small fields are copied into blocks owned by
+// the sink, while string/bytes payloads of at least threshold bytes are referenced in place, so the encoded
+// message must outlive the iovecs. Callers split the list themselves if it exceeds IOV_MAX.
+class IovecSink
+{
+public:
+    explicit IovecSink(size_t threshold = 1024, size_t blockSize = 4096)
+      : threshold_(threshold)
+      , blockSize_(blockSize)
+      , block_(0)
+      , used_(0)
+      , size_(0)
+    {
+    }
+
+    bool Write(const uint8_t* data, size_t size)
+    {
+        while (size > 0) {
+            if (used_ == blockSize_) {
+                block_++;
+                used_ = 0;
+            }
+            if (block_ == blocks_.size()) {
+                blocks_.push_back(std::make_unique_for_overwrite<uint8_t[]>(blockSize_));
+            }
+
+            auto n = std::min(size, blockSize_ - used_);
+            auto dst = blocks_[block_].get() + used_;
+            std::memcpy(dst, data, n);
+            Append(dst, n);
+            data += n;
+            size -= n;
+            used_ += n;
+        }
+        return true;
+    }
+
+    bool Reference(const uint8_t* data, size_t size)
+    {
+        Append(data, size);
+        return true;
+    }
+
+    size_t Threshold() const { return threshold_; }
+
+    std::span<const iovec> Iovecs() const { return iovecs_; }
+
+    size_t Size() const { return size_; }
+
+    // Keeps the allocated blocks for the next message.
+    void Clear()
+    {
+        iovecs_.clear();
+        block_ = 0;
+        used_ = 0;
+        size_ = 0;
+    }
+
+private:
+    void Append(const uint8_t* data, size_t size)
+    {
+        size_ += size;
+        if (!iovecs_.empty()) {
+            auto& last = iovecs_.back();
+            if (static_cast<uint8_t*>(last.iov_base) + last.iov_len == data) {
+                last.iov_len += size;
+                return;
+            }
+        }
+        iovecs_.push_back({ const_cast<uint8_t*>(data), size });
+    }
+
+    size_t threshold_;
+    size_t blockSize_;
+    size_t block_;
+    size_t used_;
+    size_t size_;
+    std::vector<std::unique_ptr<uint8_t[]>> blocks_;
+    std::vector<iovec> iovecs_;
+};
+
+// Writes to a file descriptor. The encoder's stream buffer bounds how much is held in memory.
+class FdSink
+{
+public:
+    explicit FdSink(int fd)
+      : fd_(fd)
+    {
+    }
+
+    bool Write(const uint8_t* data, size_t size)
+    {
+        while (size > 0) {
+            auto n = ::write(fd_, data, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+private:
+    int fd_;
+};
+
+} // namespace kun
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations by replacing the global operator new. Included by one file of a test or benchmark
+// executable. Atomic, as some tests allocate on several threads.
+inline std::atomic<size_t> allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    if (auto p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
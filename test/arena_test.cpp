@@ -0,0 +1,129 @@
+#include <memory_resource>
+#include <string>
+
+#include <codec.h>
+#include <gtest/gtest.h>
+
+#include "arena.kun.h"
+
+// arena.proto is generated with alloc=arena
+
+// counts the blocks an arena takes from upstream
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    size_t allocations = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        allocations++;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// longer than any small string buffer
+std::pmr::string Long(const std::string& s)
+{
+    return std::pmr::string(s + std::string(64, '.'));
+}
+
+void Fill(kunarena::Request& req)
+{
+    req.id = 7;
+    req.path = Long("/a/b");
+    req.headers.push_back(Long("x: 1"));
+    req.headers.push_back("");
+    req.item.emplace().name = Long("item");
+    req.item->ints = { 1, -2, 3 };
+    for (int i = 0; i < 100; i++) {
+        auto& item = req.items.emplace_back();
+        item.name = Long(std::to_string(i));
+        item.ints.assign(i, i);
+        item.blob = Long("blob");
+    }
+    req.named[Long("k")].name = Long("named");
+    req.codes[404] = Long("not found");
+    req.weights = { 0.5, 1.5 };
+    req.flags = { true, false, true };
+}
+
+bool Within(const std::pmr::string& s, std::pmr::memory_resource* resource)
+{
+    return s.get_allocator().resource() == resource;
+}
+
+TEST(Arena, decode)
+{
+    kunarena::Request req;
+    Fill(req);
+    kun::Encoder enc;
+    enc.Encode(req);
+    std::string data = enc.Str();
+
+    CountingResource upstream;
+    kun::Arena arena(4096, &upstream);
+
+    // everything the decoded tree allocates has to come from the arena
+    auto previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    kun::Decoder dec(data);
+    auto out = dec.Decode<kunarena::Request>(arena);
+    std::pmr::set_default_resource(previous);
+
+    ASSERT_NE(out, nullptr);
+    EXPECT_EQ(*out, req);
+    EXPECT_TRUE(Within(out->path, arena.Resource()));
+    EXPECT_TRUE(Within(out->items[99].name, arena.Resource()));
+    EXPECT_TRUE(Within(out->item->name, arena.Resource()));
+    EXPECT_TRUE(Within(out->named.begin()->first, arena.Resource()));
+    EXPECT_TRUE(Within(out->named.begin()->second.name, arena.Resource()));
+
+    // a few growing blocks instead of one allocation per string, vector and node
+    EXPECT_LT(upstream.allocations, 16);
+}
+
+TEST(Arena, copy)
+{
+    kun::Arena a;
+    kun::Arena b;
+    auto x = a.Create<kunarena::Request>();
+    Fill(*x);
+
+    auto y = b.Create<kunarena::Request>(*x);
+    EXPECT_EQ(*x, *y);
+    EXPECT_TRUE(Within(y->items[0].name, b.Resource()));
+    EXPECT_TRUE(Within(y->item->name, b.Resource()));
+    EXPECT_NE(x->item.get(), y->item.get());
+
+    // moving between arenas copies, within one it takes the pointer
+    auto z = b.Create<kunarena::Request>();
+    *z = std::move(*x);
+    EXPECT_EQ(*z, *y);
+    EXPECT_TRUE(Within(z->item->name, b.Resource()));
+
+    auto item = y->item.get();
+    auto w = b.Create<kunarena::Request>();
+    *w = std::move(*y);
+    EXPECT_EQ(w->item.get(), item);
+}
+
+TEST(Arena, malformed)
+{
+    kunarena::Request req;
+    Fill(req);
+    kun::Encoder enc;
+    enc.Encode(req);
+    std::string data = enc.Str();
+    data.resize(data.size() - 1);
+
+    kun::Arena arena;
+    kun::Decoder dec(data);
+    EXPECT_EQ(dec.Decode<kunarena::Request>(arena), nullptr);
+}
@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <chrono>
 #include <cstddef>
 #include <cstdlib>
@@ -6,15 +7,45 @@
 #include <limits>
 #include <random>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/json/json.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <gperftools/profiler.h>
 
 #include "a.kun.h"
 #include "b.pb.h"
 #include "codec.h"
+#include "test/allocations.h"
 #include "test/helper.h"
 
+// Splits an encoded message into its fields and joins them again in random order.
+std::string Shuffle(const std::string& data, std::mt19937& rng)
+{
+    using google::protobuf::internal::WireFormatLite;
+
+    std::vector<std::string_view> fields;
+    google::protobuf::io::CodedInputStream in(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    for (;;) {
+        auto begin = in.CurrentPosition();
+        auto tag = in.ReadTag();
+        if (tag == 0 || !WireFormatLite::SkipField(&in, tag)) {
+            break;
+        }
+        fields.push_back(std::string_view{ data }.substr(begin, in.CurrentPosition() - begin));
+    }
+
+    std::shuffle(fields.begin(), fields.end(), rng);
+
+    std::string out;
+    for (auto field : fields) {
+        out.append(field);
+    }
+    return out;
+}
+
 int main(int argc, char* argv[])
 {
     int n = 100;
@@ -43,6 +74,7 @@ int main(int argc, char* argv[])
     if (type == "encode") {
         {
             auto start = std::chrono::steady_clock::now();
+            auto allocs = allocations;
             // ProfilerStart("kun.prof");
             size_t size = 0;
             for (int i = 0; i < n; i++) {
@@ -53,52 +85,88 @@ int main(int argc, char* argv[])
             // ProfilerStop();
             auto end = std::chrono::steady_clock::now();
             std::cout << "kun cost: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
-                      << "ms, bytes: " << size << std::endl;
+                      << "ms, bytes: " << size << ", allocs/msg: " << double(allocations - allocs) / n << std::endl;
         }
 
         {
             auto start = std::chrono::steady_clock::now();
-            // ProfilerStart("pb.prof");
+            auto allocs = allocations;
             size_t size = 0;
+            kun::Encoder enc;
+            std::string out;
             for (int i = 0; i < n; i++) {
-                size += b.SerializeAsString().size();
+                out.clear();
+                enc.Encode(a, out);
+                size += out.size();
             }
-            // ProfilerStop();
             auto end = std::chrono::steady_clock::now();
-            std::cout << "pb cost: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
-                      << "ms, bytes: " << size << std::endl;
+            std::cout << "kun reuse cost: "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                      << "ms, bytes: " << size << ", allocs/msg: " << double(allocations - allocs) / n << std::endl;
         }
-    } else {
+
         {
             auto start = std::chrono::steady_clock::now();
-            // ProfilerStart("bench.prof");
+            auto allocs = allocations;
             size_t size = 0;
+            kun::ReverseEncoder enc;
             for (int i = 0; i < n; i++) {
-                kuntest::AAA aaa;
-                kun::Decoder dec(s);
-                if (dec.Decode(aaa)) {
-                    size++;
-                }
+                size += enc.Encode(a).size();
             }
-            // ProfilerStop();
             auto end = std::chrono::steady_clock::now();
-            std::cout << "kun cost: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
-                      << "ms, n: " << size << std::endl;
+            std::cout << "kun reverse cost: "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                      << "ms, bytes: " << size << ", allocs/msg: " << double(allocations - allocs) / n << std::endl;
         }
 
-        // std::string s;
-        // google::protobuf::json::MessageToJsonString(b, &s);
-        // std::cout << s << std::endl;
         {
             auto start = std::chrono::steady_clock::now();
+            auto allocs = allocations;
+            // ProfilerStart("pb.prof");
             size_t size = 0;
             for (int i = 0; i < n; i++) {
-                pbtest::AAA aaa;
-                size += aaa.ParseFromString(s);
+                size += b.SerializeAsString().size();
             }
+            // ProfilerStop();
             auto end = std::chrono::steady_clock::now();
             std::cout << "pb cost: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
-                      << "ms, n: " << size << std::endl;
+                      << "ms, bytes: " << size << ", allocs/msg: " << double(allocations - allocs) / n << std::endl;
+        }
+    } else {
+        // protobuf writes fields by number, which is what the generated decoders predict; the shuffled copy makes
+        // every prediction miss
+        std::mt19937 shuffleRng(n);
+        for (auto& [order, data] : { std::pair{ "in order", s }, std::pair{ "shuffled", Shuffle(s, shuffleRng) } }) {
+            {
+                auto start = std::chrono::steady_clock::now();
+                // ProfilerStart("bench.prof");
+                size_t size = 0;
+                for (int i = 0; i < n; i++) {
+                    kuntest::AAA aaa;
+                    kun::Decoder dec(data);
+                    if (dec.Decode(aaa)) {
+                        size++;
+                    }
+                }
+                // ProfilerStop();
+                auto end = std::chrono::steady_clock::now();
+                std::cout << "kun cost (" << order
+                          << "): " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                          << "ms, n: " << size << std::endl;
+            }
+
+            {
+                auto start = std::chrono::steady_clock::now();
+                size_t size = 0;
+                for (int i = 0; i < n; i++) {
+                    pbtest::AAA aaa;
+                    size += aaa.ParseFromString(data);
+                }
+                auto end = std::chrono::steady_clock::now();
+                std::cout << "pb cost (" << order
+                          << "): " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                          << "ms, n: " << size << std::endl;
+            }
         }
     }
 
@@ -0,0 +1,176 @@
+#include <deque>
+#include <map>
+#include <memory_resource>
+
+#include <codec.h>
+#include <gtest/gtest.h>
+
+#include "container.kun.h"
+#include "test/helper.h"
+
+// container.proto is generated with repeated=::kun::SmallVector, map=std::map and
+// container=kuncontainer.Request.items=::kun::SmallVector
+
+static_assert(std::is_same_v<decltype(kuncontainer::Request::codes), kun::SmallVector<int32_t>>);
+static_assert(std::is_same_v<decltype(kuncontainer::Request::items), kun::SmallVector<kuncontainer::Item>>);
+static_assert(std::is_same_v<decltype(kuncontainer::Request::others), std::vector<kuncontainer::Item>>);
+static_assert(std::is_same_v<decltype(kuncontainer::Request::counts), std::map<std::string, int32_t>>);
+
+// packed fields are copied as one block, only bool elements may be stored otherwise
+static_assert(kun::RepeatedContainer<kun::SmallVector<int32_t>>);
+static_assert(kun::RepeatedContainer<std::vector<bool>>);
+static_assert(!kun::RepeatedContainer<std::deque<int32_t>>);
+
+kuncontainer::Request MakeRequest(size_t n)
+{
+    kuncontainer::Request r;
+    r.id = 1;
+    for (size_t i = 0; i < n; i++) {
+        r.codes.push_back(i * 1000);
+        r.deltas.push_back(-int64_t(i) << 40);
+        r.weights.push_back(i * 0.5);
+        r.flags.push_back(i % 2);
+        r.tags.push_back("tag " + std::to_string(i));
+        r.kinds.push_back(i % 2 ? kuncontainer::Kind::SMALL : kuncontainer::Kind::LARGE);
+        auto& item = r.items.emplace_back();
+        item.name = "item " + std::to_string(i);
+        item.ids = { int32_t(i), -1 };
+        r.others.push_back(item);
+        r.counts["count " + std::to_string(i)] = i;
+    }
+    return r;
+}
+
+TEST(Container, roundtrip)
+{
+    // inline, full, and spilled to the heap
+    for (size_t n : { 0, 1, 4, 5, 100 }) {
+        auto r = MakeRequest(n);
+        kun::Encoder enc;
+        enc.Encode(r);
+        std::string data = enc.Str();
+        EXPECT_EQ(r.ByteSize(), data.size());
+        EXPECT_EQ(Decoded<kuncontainer::Request>(data), r);
+
+        kun::ReverseEncoder reverse;
+        EXPECT_EQ(Decoded<kuncontainer::Request>(std::string(reverse.Encode(r))), r);
+
+        // decoding again reuses the cleared elements
+        kuncontainer::Request reused = MakeRequest(3);
+        reused.Clear();
+        kun::Decoder dec(data);
+        EXPECT_TRUE(dec.DecodeReuse(reused));
+        EXPECT_EQ(reused, r);
+    }
+}
+
+TEST(Container, smallVector)
+{
+    kun::SmallVector<std::string, 2> v;
+    v.emplace_back("a");
+    v.emplace_back("b");
+    auto inlined = v.data();
+    EXPECT_EQ(v.capacity(), 2);
+
+    // moved one by one while inline
+    auto moved = std::move(v);
+    EXPECT_TRUE(v.empty());
+    EXPECT_EQ(v.data(), inlined);
+    EXPECT_EQ(moved, (kun::SmallVector<std::string, 2>{ "a", "b" }));
+
+    moved.emplace_back("c");
+    EXPECT_GT(moved.capacity(), 2);
+    auto heap = moved.data();
+
+    // the buffer is taken over once allocated
+    v = std::move(moved);
+    EXPECT_EQ(v.data(), heap);
+    EXPECT_EQ(moved.capacity(), 2);
+
+    auto copy = v;
+    EXPECT_EQ(copy, v);
+    EXPECT_NE(copy.data(), v.data());
+
+    v.resize(1);
+    EXPECT_EQ(v, (kun::SmallVector<std::string, 2>{ "a" }));
+    v.resize(3);
+    EXPECT_EQ(v[2], "");
+    v.clear();
+    EXPECT_EQ(v.data(), heap);
+}
+
+// counts the elements alive in the containers using it
+template <typename T>
+struct CountingAllocator
+{
+    using value_type = T;
+
+    explicit CountingAllocator(int* live)
+      : live(live)
+    {
+    }
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other)
+      : live(other.live)
+    {
+    }
+
+    T* allocate(size_t n) { return std::allocator<T>().allocate(n); }
+    void deallocate(T* p, size_t n) { std::allocator<T>().deallocate(p, n); }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        std::construct_at(p, std::forward<Args>(args)...);
+        ++*live;
+    }
+
+    template <typename U>
+    void destroy(U* p)
+    {
+        std::destroy_at(p);
+        --*live;
+    }
+
+    bool operator==(const CountingAllocator& other) const { return live == other.live; }
+
+    int* live;
+};
+
+// moving never allocates with the allocator copied, move assignment does when the allocators differ
+static_assert(std::is_nothrow_move_constructible_v<kun::SmallVector<std::string>>);
+static_assert(std::is_nothrow_move_assignable_v<kun::SmallVector<std::string>>);
+static_assert(!std::is_nothrow_move_assignable_v<kun::SmallVector<int, 4, std::pmr::polymorphic_allocator<int>>>);
+
+TEST(Container, smallVectorAllocator)
+{
+    using Vector = kun::SmallVector<std::string, 2, CountingAllocator<std::string>>;
+    int live = 0;
+    int other = 0;
+    {
+        // growing moves the elements through the allocator too
+        Vector v{ CountingAllocator<std::string>(&live) };
+        v.emplace_back("a");
+        v.emplace_back("b");
+        v.emplace_back("c");
+        EXPECT_EQ(live, 3);
+        v.resize(1);
+        EXPECT_EQ(live, 1);
+
+        // a different allocator gets its own elements
+        Vector w{ CountingAllocator<std::string>(&other) };
+        w = std::move(v);
+        EXPECT_EQ(live, 0);
+        EXPECT_EQ(other, 1);
+
+        auto moved = std::move(w);
+        moved.emplace_back("d");
+        EXPECT_EQ(other, 2);
+        moved.clear();
+        EXPECT_EQ(other, 0);
+        moved.emplace_back("e");
+    }
+    EXPECT_EQ(live, 0);
+    EXPECT_EQ(other, 0);
+}
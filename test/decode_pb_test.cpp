@@ -1,7 +1,10 @@
+#include <sys/uio.h>
+
 #include <codec.h>
 
 #include "a.kun.h"
 #include "b.pb.h"
+#include "test/allocations.h"
 #include "test/helper.h"
 
 void CheckDecode(const pbtest::AAA& b)
@@ -88,3 +91,282 @@ TEST(DecodePb, misc)
 
     CheckDecode(ToPb(a));
 }
+
+TEST(DecodePb, varint)
+{
+    std::vector<uint64_t> values{ 0, 1, UINT64_MAX };
+    for (int bits = 7; bits < 64; bits += 7) {
+        values.push_back((uint64_t(1) << bits) - 1);
+        values.push_back(uint64_t(1) << bits);
+    }
+
+    for (auto v : values) {
+        pbtest::AAA b;
+        b.set_u64(v);
+        b.set_i64(static_cast<int64_t>(v));
+        b.set_i32(static_cast<int32_t>(v));
+        b.set_u32(static_cast<uint32_t>(v));
+        b.add_u64s(v);
+        b.add_i32s(static_cast<int32_t>(v));
+        CheckDecode(b);
+
+        // cut inside u64s, the last field on the wire
+        auto data = b.SerializeAsString();
+        for (size_t i = 1; i <= kun::Encoding<>::EncodedSize(v); i++) {
+            kuntest::AAA a;
+            kun::Decoder dec(reinterpret_cast<const uint8_t*>(data.data()), data.size() - i);
+            EXPECT_FALSE(dec.Decode(a));
+        }
+    }
+}
+
+TEST(DecodePb, packedAppend)
+{
+    // the same packed field twice on the wire appends, as a merge does
+    pbtest::AAA b1 = ToPb(GenAAA());
+    pbtest::AAA b2 = ToPb(GenAAA());
+    auto data = b1.SerializeAsString() + b2.SerializeAsString();
+
+    pbtest::AAA b;
+    b.ParseFromString(data);
+
+    kuntest::AAA a;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(a));
+
+    EXPECT_EQ(a.i32s.size(), b1.i32s_size() + b2.i32s_size());
+    EXPECT_EQ(a.s64s.size(), b1.s64s_size() + b2.s64s_size());
+    EXPECT_EQ(a.es.size(), b1.es_size() + b2.es_size());
+    EXPECT_EQ(a.fs.size(), b1.fs_size() + b2.fs_size());
+    EXPECT_EQ(a.sf64s.size(), b1.sf64s_size() + b2.sf64s_size());
+    EXPECT_EQ(a.bs.size(), b1.bs_size() + b2.bs_size());
+    for (int i = 0; i < b.i32s_size(); i++) {
+        EXPECT_EQ(a.i32s[i], b.i32s(i));
+    }
+    for (int i = 0; i < b.u32s_size(); i++) {
+        EXPECT_EQ(a.u32s[i], b.u32s(i));
+    }
+    for (int i = 0; i < b.s32s_size(); i++) {
+        EXPECT_EQ(a.s32s[i], b.s32s(i));
+    }
+    for (int i = 0; i < b.s64s_size(); i++) {
+        EXPECT_EQ(a.s64s[i], b.s64s(i));
+    }
+    for (int i = 0; i < b.es_size(); i++) {
+        EXPECT_EQ(static_cast<int>(a.es[i]), b.es(i));
+    }
+}
+
+TEST(DecodePb, reuse)
+{
+    kuntest::AAA a = GenAAA();
+    a.bbb = std::make_unique<kuntest::BBB>();
+    GenRandRepeated(a.bbb->value);
+    a.bbbs.resize(5);
+    for (auto& bbb : a.bbbs) {
+        GenRandRepeated(bbb.ints);
+        GenRandRepeated(bbb.value);
+    }
+    // map nodes are not kept
+    a.kvs.clear();
+    a.kvs2.clear();
+    auto b = ToPb(a);
+    auto data = b.SerializeAsString();
+
+    kuntest::AAA out;
+    for (int i = 0; i < 3; i++) {
+        kun::Decoder dec(data);
+        size_t before = allocations;
+        EXPECT_TRUE(dec.DecodeReuse(out));
+        // the first pass fills the message, the second the spare buffers
+        if (i == 2) {
+            EXPECT_EQ(allocations, before);
+        }
+        ExpectEQ(out, b);
+    }
+
+    out.Clear();
+    EXPECT_EQ(out, kuntest::AAA{});
+    EXPECT_EQ(out.ByteSize(), 0);
+}
+
+// nothing in a.proto points into the decoded buffer
+static_assert(!kun::views_buffer_v<kuntest::AAA>);
+
+TEST(DecodePb, stream)
+{
+    kuntest::AAA a = GenAAA();
+    a.bbb = std::make_unique<kuntest::BBB>();
+    GenRandRepeated(a.bbb->value);
+    auto b = ToPb(a);
+    auto data = b.SerializeAsString();
+
+    for (size_t piece : { size_t(1), size_t(7), size_t(100), size_t(4096), data.size() }) {
+        kuntest::AAA out;
+        kun::StreamDecoder stream(out);
+        for (size_t i = 0; i < data.size(); i += piece) {
+            // a copy that is gone after Feed(), as a socket buffer would be
+            std::string chunk = data.substr(i, piece);
+            ASSERT_TRUE(stream.Feed(chunk));
+        }
+        EXPECT_TRUE(stream.Finish());
+        ExpectEQ(out, b);
+    }
+
+    // ends inside a field
+    kuntest::AAA out;
+    kun::StreamDecoder stream(out);
+    EXPECT_TRUE(stream.Feed(std::string_view(data).substr(0, data.size() - 1)));
+    EXPECT_TRUE(stream.NeedMore());
+    EXPECT_FALSE(stream.Finish());
+
+    // a split sub-message is entered, not buffered until it is whole
+    kuntest::AAA nested;
+    nested.bbb = std::make_unique<kuntest::BBB>();
+    nested.bbb->value.assign(1000, std::string(100, 'x'));
+    auto whole = ToPb(nested).SerializeAsString();
+    kuntest::AAA part;
+    kun::StreamDecoder partial(part);
+    ASSERT_TRUE(partial.Feed(std::string_view(whole).substr(0, whole.size() / 2)));
+    ASSERT_TRUE(part.bbb);
+    EXPECT_GT(part.bbb->value.size(), 400);
+    EXPECT_TRUE(partial.NeedMore());
+    ASSERT_TRUE(partial.Feed(std::string_view(whole).substr(whole.size() / 2)));
+    EXPECT_TRUE(partial.Finish());
+    EXPECT_EQ(part.bbb->value, nested.bbb->value);
+
+    // wire type 7 does not exist
+    kuntest::AAA bad;
+    kun::StreamDecoder malformed(bad);
+    EXPECT_FALSE(malformed.Feed(std::string_view("\x0f")));
+    EXPECT_FALSE(malformed.Feed(data));
+}
+
+TEST(DecodePb, segments)
+{
+    kuntest::AAA a = GenAAA();
+    a.bbb = std::make_unique<kuntest::BBB>();
+    a.bbb->value.assign(1000, std::string(100, 'x'));
+    auto b = ToPb(a);
+    auto data = b.SerializeAsString();
+
+    // random cuts, each piece in a buffer of its own as readv() would leave them
+    std::vector<std::string> pieces;
+    for (size_t i = 0; i < data.size();) {
+        size_t n = std::min<size_t>(rng() % 64 + 1, data.size() - i);
+        pieces.push_back(data.substr(i, n));
+        i += n;
+    }
+    std::vector<iovec> iov;
+    std::vector<std::string_view> views;
+    for (auto& piece : pieces) {
+        iov.push_back(iovec{ piece.data(), piece.size() });
+        views.push_back(piece);
+    }
+
+    kuntest::AAA x;
+    EXPECT_TRUE(kun::DecodeSegments(x, iov));
+    ExpectEQ(x, b);
+
+    kuntest::AAA y;
+    EXPECT_TRUE(kun::DecodeSegments(y, views));
+    ExpectEQ(y, b);
+
+    // cuts of one buffer are joined and decode in place
+    std::vector<std::string_view> cuts{ std::string_view(data).substr(0, 10), std::string_view(data).substr(10) };
+    kuntest::AAA w;
+    EXPECT_TRUE(kun::DecodeSegments(w, cuts));
+    ExpectEQ(w, b);
+
+    // the last byte is missing
+    views.back().remove_suffix(1);
+    kuntest::AAA z;
+    EXPECT_FALSE(kun::DecodeSegments(z, views));
+}
+
+TEST(DecodePb, mask)
+{
+    using kuntest::AAA;
+
+    AAA a = GenAAA();
+    a.bbb = std::make_unique<kuntest::BBB>();
+    GenRandRepeated(a.bbb->value);
+    GenRandRepeated(a.bbb->ints);
+    a.bbbs.resize(3);
+    for (auto& bbb : a.bbbs) {
+        GenRandRepeated(bbb.ints);
+        GenRandRepeated(bbb.value);
+    }
+    auto data = ToPb(a).SerializeAsString();
+
+    auto bbbs = kun::FieldMask{ kun::IndexOf<kuntest::BBB>("ints") };
+    kun::FieldMask mask{ kun::IndexOf<AAA>("i32"), kun::IndexOf<AAA>("ss"), kun::IndexOf<AAA>("bbb") };
+    mask.Add(kun::IndexOf<AAA>("bbbs"), bbbs);
+
+    AAA out;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(out, mask));
+    EXPECT_EQ(out.i32, a.i32);
+    EXPECT_EQ(out.ss, a.ss);
+    ASSERT_NE(out.bbb, nullptr);
+    EXPECT_EQ(*out.bbb, *a.bbb);
+    ASSERT_EQ(out.bbbs.size(), a.bbbs.size());
+    for (size_t i = 0; i < a.bbbs.size(); i++) {
+        EXPECT_EQ(out.bbbs[i].ints, a.bbbs[i].ints);
+        EXPECT_TRUE(out.bbbs[i].value.empty());
+    }
+    EXPECT_TRUE(out.s.empty());
+    EXPECT_TRUE(out.i32s.empty());
+    EXPECT_TRUE(out.kvs2.empty());
+
+    // fixed at compile time
+    AAA fixed;
+    kun::Decoder dec2(data);
+    EXPECT_TRUE(dec2.Decode(fixed, kun::Fields<kun::IndexOf<AAA>("u64"), kun::IndexOf<AAA>("bts")>{}));
+    EXPECT_EQ(fixed.u64, a.u64);
+    EXPECT_EQ(fixed.bts, a.bts);
+    EXPECT_EQ(fixed.u32, 0);
+    EXPECT_EQ(fixed.bbb, nullptr);
+
+    // skipped fields are still checked to be well-formed
+    kun::Decoder truncated(reinterpret_cast<const uint8_t*>(data.data()), data.size() - 1);
+    AAA bad;
+    EXPECT_FALSE(truncated.Decode(bad, kun::Fields<>{}));
+}
+
+TEST(DecodePb, parallel)
+{
+    kuntest::AAA a = GenAAA();
+    a.bbbs.resize(200);
+    for (auto& bbb : a.bbbs) {
+        GenRandRepeated(bbb.ints);
+        GenRandRepeated(bbb.value);
+    }
+    a.bbbs[100].ints = { 1, 2, 3 };
+    auto b = ToPb(a);
+    auto data = b.SerializeAsString();
+
+    kuntest::AAA sequential;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(sequential));
+
+    for (size_t threads : { 1, 2, 4, 7 }) {
+        kuntest::AAA out;
+        kun::Decoder dec(data);
+        EXPECT_TRUE(dec.DecodeParallel(out, kun::ThreadExecutor(threads)));
+        EXPECT_EQ(out.bbbs, sequential.bbbs);
+        ExpectEQ(out, b);
+    }
+
+    // a broken element is only seen by its task
+    auto bad = data;
+    auto pos = bad.find(b.bbbs(100).SerializeAsString());
+    ASSERT_NE(pos, std::string::npos);
+    bad[pos] = 0x0f;
+    kuntest::AAA x;
+    kun::Decoder seq(bad);
+    EXPECT_FALSE(seq.Decode(x));
+    kuntest::AAA y;
+    kun::Decoder par(bad);
+    EXPECT_FALSE(par.DecodeParallel(y, kun::ThreadExecutor(4)));
+}
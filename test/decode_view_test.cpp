@@ -0,0 +1,103 @@
+#include <cstring>
+
+#include <codec.h>
+#include <gtest/gtest.h>
+
+#include "view.kun.h"
+
+// view.proto is generated with string=view and packed=view
+
+// so StreamDecoder and DecodeSegments refuse them
+static_assert(kun::views_buffer_v<kunview::Inner>);
+static_assert(kun::views_buffer_v<kunview::Request>);
+
+bool Within(std::string_view view, const std::string& data)
+{
+    return view.empty() || (view.data() >= data.data() && view.data() + view.size() <= data.data() + data.size());
+}
+
+TEST(DecodeView, strings)
+{
+    using namespace std::literals;
+
+    kunview::Request req;
+    req.path = "/a/b";
+    req.body = "\0\1\2"sv;
+    req.headers = { "x: 1", "", "y: 2" };
+    req.id = 7;
+    req.inner = std::make_unique<kunview::Inner>();
+    req.inner->name = "inner";
+    req.inner->blobs = { "b1", "b2" };
+    req.inners.resize(2);
+    req.inners[1].name = "second";
+    req.attrs["k"] = "v";
+    req.features = { 0.5f, -1.0f, 3.25f };
+    req.ids = { 1, UINT64_MAX };
+    req.weights = std::vector<double>(100, 0.25);
+
+    kun::Encoder enc;
+    enc.Encode(req);
+    std::string data = enc.Str();
+
+    kunview::Request out;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(out));
+    EXPECT_EQ(out, req);
+
+    EXPECT_TRUE(Within(out.path, data));
+    EXPECT_TRUE(Within(out.body, data));
+    for (auto header : out.headers) {
+        EXPECT_TRUE(Within(header, data));
+    }
+    ASSERT_TRUE(out.inner);
+    EXPECT_TRUE(Within(out.inner->name, data));
+    for (auto blob : out.inner->blobs) {
+        EXPECT_TRUE(Within(blob, data));
+    }
+    EXPECT_TRUE(Within(out.inners[1].name, data));
+}
+
+TEST(DecodeView, packed)
+{
+    kunview::Request req;
+    req.features = { 0.5f, -1.0f, 3.25f };
+    kun::Encoder enc;
+    enc.Encode(req);
+    // tag and length take a byte each
+    std::string data = enc.Str();
+    ASSERT_EQ(data.size(), 2 + 3 * sizeof(float));
+
+    alignas(8) uint8_t buffer[64];
+    auto decode = [&](size_t offset) {
+        std::memcpy(buffer + offset, data.data(), data.size());
+        kunview::Request out;
+        kun::Decoder dec(buffer + offset, data.size());
+        EXPECT_TRUE(dec.Decode(out));
+        EXPECT_EQ(out, req);
+        return out;
+    };
+
+    // points into the input where the floats are aligned, copies where they are not
+    auto aligned = decode(2);
+    EXPECT_EQ(reinterpret_cast<const uint8_t*>(aligned.features.data()), buffer + 4);
+    auto misaligned = decode(1);
+    EXPECT_NE(reinterpret_cast<const uint8_t*>(misaligned.features.data()), buffer + 3);
+
+    // a copy outlives the input, a move keeps pointing into it
+    auto copy = misaligned;
+    std::memset(buffer, 0, sizeof(buffer));
+    EXPECT_EQ(copy, req);
+    auto moved = std::move(aligned);
+    EXPECT_EQ(reinterpret_cast<const uint8_t*>(moved.features.data()), buffer + 4);
+
+    // split over two records it is appended into a copy
+    std::string twice = data + data;
+    kunview::Request out;
+    kun::Decoder dec(twice);
+    EXPECT_TRUE(dec.Decode(out));
+    std::vector<float> expected = { 0.5f, -1.0f, 3.25f, 0.5f, -1.0f, 3.25f };
+    EXPECT_TRUE(std::ranges::equal(out.features, expected));
+
+    out.Clear();
+    EXPECT_TRUE(out.features.empty());
+}
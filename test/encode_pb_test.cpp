@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <bit>
 #include <string>
 #include <type_traits>
 
 #include <codec.h>
 #include <kun.h>
+#include <sink.h>
 
 #include "a.kun.h"
 #include "b.pb.h"
@@ -96,9 +98,153 @@ TEST(EncodePb, map)
     CheckEncode(a);
 }
 
+TEST(EncodePb, mapEntrySize)
+{
+    // the key and the value are each sized with their own encoding: sint32 -1 takes one byte, int64 -1 ten
+    std::pair<const int32_t, int64_t> entry{ -1, -1 };
+    kun::ConstMapEntry<int32_t, int64_t, (kun::ENCODING_ZIGZAG << 8) | kun::ENCODING_VARINT> e{ entry };
+    EXPECT_EQ(e.ByteSize(), 2 + 11);
+}
+
 TEST(EncodePb, misc)
 {
     kuntest::AAA a = GenAAA();
 
     CheckEncode(a);
 }
+
+TEST(EncodePb, reuse)
+{
+    kun::Encoder enc;
+    std::string str;
+    kun::Buffer buf;
+    std::vector<uint8_t> span(1 << 20);
+
+    for (int i = 0; i < 3; i++) {
+        kuntest::AAA a = GenAAA();
+        pbtest::AAA b;
+
+        enc.Encode(a);
+        EXPECT_TRUE(b.ParseFromString(enc.Str()));
+        ExpectEQ(a, b);
+
+        str.clear();
+        enc.Encode(a, str);
+        EXPECT_EQ(str, enc.Str());
+
+        buf.clear();
+        enc.Encode(a, buf);
+        EXPECT_TRUE(b.ParseFromArray(buf.data(), buf.size()));
+        ExpectEQ(a, b);
+
+        auto [ok, size] = enc.Encode(a, std::span<uint8_t>{ span });
+        EXPECT_TRUE(ok);
+        EXPECT_TRUE(b.ParseFromArray(span.data(), size));
+        ExpectEQ(a, b);
+
+        std::tie(ok, size) = enc.Encode(a, std::span<uint8_t>{ span.data(), 1 });
+        EXPECT_EQ(ok, a.ByteSize() <= 1);
+    }
+}
+
+TEST(EncodePb, stream)
+{
+    kuntest::AAA a = GenAAA();
+    a.bt.assign(200000, 'x');
+    kun::Encoder flat;
+    flat.Encode(a);
+
+    kun::ChunkSink sink(1000);
+    kun::BasicEncoder<kun::ChunkSink> enc;
+    EXPECT_TRUE(enc.Encode(a, sink));
+
+    std::string data;
+    for (size_t i = 0; i < sink.ChunkCount(); i++) {
+        auto chunk = sink.Chunk(i);
+        data.append(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    }
+    EXPECT_EQ(data, flat.Str());
+}
+
+TEST(EncodePb, iovec)
+{
+    kuntest::AAA a = GenAAA();
+    a.bt.assign(5000, 'x');
+    a.bts.push_back(std::string(3000, 'y'));
+    kun::Encoder flat;
+    flat.Encode(a);
+
+    kun::IovecSink sink(100);
+    kun::BasicEncoder<kun::IovecSink> enc;
+    EXPECT_TRUE(enc.Encode(a, sink));
+
+    std::string data;
+    for (auto& iov : sink.Iovecs()) {
+        data.append(static_cast<const char*>(iov.iov_base), iov.iov_len);
+    }
+    EXPECT_EQ(sink.Size(), data.size());
+    EXPECT_EQ(data, flat.Str());
+    EXPECT_TRUE(std::ranges::any_of(sink.Iovecs(), [&](auto& iov) { return iov.iov_base == a.bt.data(); }));
+}
+
+TEST(EncodePb, reverse)
+{
+    kuntest::AAA a = GenAAA();
+    a.bbbs.resize(3);
+    a.bbbs[1].value.push_back("bbb");
+
+    kun::ReverseEncoder enc;
+    pbtest::AAA b;
+    EXPECT_TRUE(b.ParseFromString(std::string{ enc.Encode(a) }));
+    ExpectEQ(a, b);
+
+    // map entry order is the only difference from Encoder
+    a.kvs.clear();
+    a.kvs2.clear();
+    kun::Encoder flat;
+    flat.Encode(a);
+    EXPECT_EQ(enc.Encode(a), flat.Str());
+}
+
+TEST(EncodePb, order)
+{
+    // fields are written by number, so without maps the output is what protobuf writes
+    kuntest::AAA a = GenAAA();
+    a.kvs.clear();
+    a.kvs2.clear();
+
+    kun::Encoder enc;
+    enc.Encode(a);
+    EXPECT_EQ(enc.Str(), ToPb(a).SerializeAsString());
+}
+
+TEST(EncodePb, parallel)
+{
+    kuntest::AAA a = GenAAA();
+    a.bbb = std::make_unique<kuntest::BBB>();
+    GenRandRepeated(a.bbb->value);
+    // several chunks, the last one short
+    a.bbbs.resize(kun::ParallelSizes::kChunk * 3 + 17);
+    for (auto& bbb : a.bbbs) {
+        GenRandRepeated(bbb.ints);
+        GenRandRepeated(bbb.value);
+    }
+
+    kun::Encoder enc;
+    enc.Encode(a);
+    auto size = a.ByteSize();
+
+    for (size_t threads : { 1, 2, 4, 7 }) {
+        EXPECT_EQ(kun::ByteSizeParallel(a, kun::ThreadExecutor(threads)), size);
+
+        kun::Encoder parallel;
+        parallel.EncodeParallel(a, kun::ThreadExecutor(threads));
+        EXPECT_EQ(parallel.Str(), enc.Str());
+    }
+
+    // nothing to split
+    kuntest::AAA empty;
+    kun::Encoder parallel;
+    parallel.EncodeParallel(empty, kun::ThreadExecutor(4));
+    EXPECT_TRUE(parallel.Str().empty());
+}
@@ -0,0 +1,125 @@
+#include <ranges>
+
+#include <codec.h>
+#include <gtest/gtest.h>
+
+#include "a.kun.h"
+#include "test/helper.h"
+
+// a.kun.h here is generated with map=flat
+
+static_assert(std::is_same_v<decltype(kuntest::AAA::kvs2), kun::FlatMap<std::string, kuntest::BBB>>);
+
+TEST(FlatMap, decode)
+{
+    kuntest::AAA a;
+    for (int i = 0; i < 1000; i++) {
+        a.kvs[i * 7919 % 1000] = i;
+        a.kvs2["key " + std::to_string(i)].value = { std::to_string(i) };
+    }
+    EXPECT_TRUE(std::ranges::is_sorted(a.kvs | std::views::keys));
+
+    // the entries are written in key order, so the output is the same whatever the order they were added in, and
+    // decoding appends them without sorting
+    auto data = EncodeChecked(a);
+
+    kuntest::AAA out;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(out));
+    EXPECT_EQ(out.kvs, a.kvs);
+    EXPECT_EQ(out.kvs2, a.kvs2);
+    EXPECT_EQ(EncodeChecked(out), data);
+}
+
+TEST(FlatMap, lastWins)
+{
+    kuntest::AAA first;
+    first.kvs = { { 1, 1 }, { 2, 2 }, { 3, 3 } };
+    first.kvs2["a"].value = { "first" };
+    kuntest::AAA second;
+    second.kvs = { { 3, 30 }, { 0, 0 }, { 2, 20 } };
+    second.kvs2["a"].value = { "second" };
+
+    // concatenated messages merge, like protobuf the entry seen last wins
+    auto data = EncodeChecked(first) + EncodeChecked(second);
+    kuntest::AAA out;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(out));
+    EXPECT_EQ(out.kvs, (kun::FlatMap<int32_t, int32_t>{ { 0, 0 }, { 1, 1 }, { 2, 20 }, { 3, 30 } }));
+    ASSERT_EQ(out.kvs2.size(), 1);
+    EXPECT_EQ(out.kvs2.at("a").value, std::vector<std::string>{ "second" });
+}
+
+TEST(FlatMap, lookup)
+{
+    kun::FlatMap<std::string, int> m;
+    m.Append({ "b", 1 });
+    m.Append({ "a", 2 });
+    m.Append({ "b", 3 });
+    m.Build();
+    EXPECT_EQ(m, (kun::FlatMap<std::string, int>{ { "a", 2 }, { "b", 3 } }));
+
+    // found by a std::string_view, no std::string made
+    EXPECT_EQ(m.find(std::string_view("b"))->second, 3);
+    EXPECT_FALSE(m.contains(std::string_view("c")));
+    EXPECT_THROW(m.at("c"), std::out_of_range);
+
+    EXPECT_FALSE(m.emplace("a", 4).second);
+    EXPECT_EQ(m["a"], 2);
+    EXPECT_FALSE(m.insert_or_assign("a", 4).second);
+    EXPECT_EQ(m["a"], 4);
+    m["0"] = 5;
+    EXPECT_EQ(m.begin()->first, "0");
+    EXPECT_EQ(m.erase("b"), 1);
+    EXPECT_EQ(m, (kun::FlatMap<std::string, int>{ { "0", 5 }, { "a", 4 } }));
+}
+
+// like std::flat_map, the keys are const through the iterators, the values are not
+using Map = kun::FlatMap<std::string, int>;
+static_assert(std::ranges::random_access_range<Map>);
+static_assert(std::is_same_v<std::iter_reference_t<Map::iterator>, std::pair<const std::string&, int&>>);
+static_assert(std::is_same_v<std::iter_reference_t<Map::const_iterator>, std::pair<const std::string&, const int&>>);
+static_assert(!std::is_assignable_v<decltype((std::declval<Map&>().begin()->first)), std::string>);
+static_assert(std::is_convertible_v<Map::iterator, Map::const_iterator>);
+
+TEST(FlatMap, iterators)
+{
+    Map m{ { "a", 1 }, { "b", 2 }, { "c", 3 } };
+    for (auto [key, value] : m) {
+        value *= 10;
+    }
+    m.begin()->second++;
+    m.rbegin()->second++;
+    EXPECT_EQ(m, (Map{ { "a", 11 }, { "b", 20 }, { "c", 31 } }));
+
+    Map::const_iterator it = m.find("b");
+    EXPECT_EQ(it - m.begin(), 1);
+    EXPECT_EQ(it[1].first, "c");
+    EXPECT_EQ(m.erase(it)->first, "c");
+    EXPECT_EQ(std::ranges::distance(m), 2);
+}
+
+TEST(FlatMap, insertAfterAppend)
+{
+    using Map = kun::FlatMap<int32_t, int32_t>;
+    Map m;
+    m.Append({ 3, 3 });
+    m.Append({ 1, 1 });
+    m.Append({ 3, 4 });
+
+    // the appended entries are sorted in first, the last of a key kept
+    m[2] = 2;
+    EXPECT_EQ(m, (Map{ { 1, 1 }, { 2, 2 }, { 3, 4 } }));
+
+    EXPECT_EQ(m.erase(1), 1);
+    m.Append({ 0, 0 });
+    EXPECT_TRUE(m.emplace(5, 5).second);
+    EXPECT_EQ(m, (Map{ { 0, 0 }, { 2, 2 }, { 3, 4 }, { 5, 5 } }));
+
+    // and kept sorted after
+    m.Append({ 4, 4 });
+    m.Build();
+    EXPECT_EQ(m.at(4), 4);
+    EXPECT_EQ(m.erase(0), 1);
+    EXPECT_EQ(m, (Map{ { 2, 2 }, { 3, 4 }, { 4, 4 }, { 5, 5 } }));
+}
@@ -35,6 +35,29 @@ bool FloatEqual(T a, T b)
     return false;
 }
 
+// encodes with both encoders and checks they agree with each other and with ByteSize
+template <typename T>
+std::string EncodeChecked(const T& value)
+{
+    kun::Encoder enc;
+    enc.Encode(value);
+    auto data = enc.Str();
+
+    kun::ReverseEncoder reverse;
+    EXPECT_EQ(reverse.Encode(value), data);
+    EXPECT_EQ(value.ByteSize(), data.size());
+    return data;
+}
+
+template <typename T>
+T Decoded(const std::string& data)
+{
+    T value;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(value));
+    return value;
+}
+
 bool operator==(const kuntest::BBB& a, const pbtest::BBB& b);
 
 template <typename T, typename U>
@@ -99,8 +122,9 @@ bool operator==(const kuntest::BBB& a, const pbtest::BBB& b)
     return (a.value == b.value()) && (a.ints == b.ints());
 }
 
-template <typename K1, typename V1, typename K2, typename V2>
-bool operator==(const std::unordered_map<K1, V1>& a, const google::protobuf::Map<K2, V2>& b)
+template <typename M, typename K2, typename V2>
+    requires kun::is_map_v<M>
+bool operator==(const M& a, const google::protobuf::Map<K2, V2>& b)
 {
     if (a.size() != b.size()) {
         return false;
@@ -257,7 +281,7 @@ pbtest::AAA ToPb(const kuntest::AAA& a)
 
 #define COPY3(name)                                                                                                    \
     do {                                                                                                               \
-        for (auto& i : a.name) {                                                                                       \
+        for (const auto& i : a.name) {                                                                                 \
             (*b.mutable_##name())[i.first] = i.second;                                                                 \
         }                                                                                                              \
     } while (0)
@@ -307,7 +331,7 @@ pbtest::AAA ToPb(const kuntest::AAA& a)
 
     COPY3(kvs);
 
-    for (auto& i : a.kvs2) {
+    for (const auto& i : a.kvs2) {
         pbtest::BBB bbb;
 
         for (auto& j : i.second.ints) {
@@ -0,0 +1,114 @@
+#include <codec.h>
+#include <gtest/gtest.h>
+
+#include "inline.kun.h"
+#include "test/helper.h"
+
+// inline.proto is generated with message=inline and table_decode=kuninline.Shape
+
+static_assert(std::is_same_v<decltype(kuninline::Shape::origin), kun::Inline<kuninline::Point>>);
+static_assert(std::is_same_v<decltype(kuninline::Shape::bounds), kun::Inline<kuninline::Box>>);
+static_assert(std::is_same_v<decltype(kuninline::Shape::label), kun::Inline<kuninline::Shape_Label>>);
+static_assert(std::is_same_v<decltype(kuninline::Shape::root), kun::Inline<kuninline::Node>>);
+static_assert(std::is_same_v<decltype(kuninline::Node::pos), kun::Inline<kuninline::Point>>);
+static_assert(std::is_same_v<decltype(kuninline::Node::next), std::unique_ptr<kuninline::Node>>);
+
+// one copy of each sub-message, nesting does not multiply the size
+static_assert(sizeof(kuninline::Box) <= 2 * sizeof(kun::Inline<kuninline::Point>) + sizeof(size_t));
+
+kuninline::Shape MakeShape()
+{
+    kuninline::Shape s;
+    s.origin.emplace().x = -1;
+    s.bounds.emplace().min.emplace().y = 2;
+    s.bounds->max.emplace() = s.bounds->min.value();
+    s.label.emplace().text = "label";
+
+    auto& root = s.root.emplace();
+    root.name = "root";
+    root.pos.emplace().x = 3;
+    root.next = std::make_unique<kuninline::Node>();
+    root.next->name = "next";
+    root.children.resize(2);
+    root.children[1].pos.emplace();
+    root.next->next = std::make_unique<kuninline::Node>();
+    root.next->next->pos.emplace().y = -4;
+    return s;
+}
+
+TEST(Inline, roundtrip)
+{
+    EXPECT_TRUE(EncodeChecked(kuninline::Shape{}).empty());
+
+    auto s = MakeShape();
+    auto data = EncodeChecked(s);
+    auto d = Decoded<kuninline::Shape>(data);
+    EXPECT_EQ(d, s);
+    ASSERT_TRUE(d.root->children[1].pos);
+    EXPECT_FALSE(d.root->children[0].pos);
+    EXPECT_EQ(EncodeChecked(d), data);
+
+    // decoded by the switch, not the parse table
+    EXPECT_EQ(Decoded<kuninline::Node>(EncodeChecked(*s.root)), *s.root);
+}
+
+TEST(Inline, merge)
+{
+    kuninline::Shape first;
+    first.origin.emplace().x = 1;
+    kuninline::Shape second;
+    second.origin.emplace().y = 2;
+    second.label.emplace().text = "second";
+
+    // like protobuf, a sub-message seen twice is merged
+    auto d = Decoded<kuninline::Shape>(EncodeChecked(first) + EncodeChecked(second));
+    ASSERT_TRUE(d.origin);
+    EXPECT_EQ(d.origin->x, 1);
+    EXPECT_EQ(d.origin->y, 2);
+    EXPECT_EQ(d.label->text, "second");
+    EXPECT_FALSE(d.bounds);
+}
+
+TEST(Inline, copy)
+{
+    auto s = MakeShape();
+    auto copy = s;
+    EXPECT_EQ(copy, s);
+    copy.root->pos->x = 4;
+    EXPECT_NE(copy, s);
+    EXPECT_EQ(s.root->pos->x, 3);
+
+    copy = s;
+    EXPECT_EQ(copy, s);
+    copy.Clear();
+    EXPECT_FALSE(copy.origin);
+    EXPECT_FALSE(copy.root);
+    EXPECT_TRUE(EncodeChecked(copy).empty());
+
+    auto moved = std::move(s);
+    EXPECT_EQ(moved, MakeShape());
+}
+
+TEST(Inline, reuse)
+{
+    auto s = MakeShape();
+    s.label->text.assign(100, 'x');
+    s.root->name.assign(100, 'y');
+    auto data = EncodeChecked(s);
+    auto text = s.label->text.data();
+    auto name = s.root->name.data();
+
+    // Clear() keeps the cleared sub-messages, decoding takes them back with the capacity of their strings
+    for (int i = 0; i < 2; i++) {
+        s.Clear();
+        EXPECT_FALSE(s.label);
+        EXPECT_FALSE(s.root);
+        // takes the memory a reset sub-message would have freed
+        std::string other(100, 'z');
+        kun::Decoder dec(data);
+        EXPECT_TRUE(dec.DecodeReuse(s));
+        EXPECT_EQ(EncodeChecked(s), data);
+        EXPECT_EQ(s.label->text.data(), text);
+        EXPECT_EQ(s.root->name.data(), name);
+    }
+}
@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <gtest/gtest.h>
+
+#include "a.kun.h"
+
+// Size of a struct with the members of C in the order given, and the size of those members without padding.
+template <typename C, typename... T>
+constexpr std::pair<size_t, size_t> Sizes(T C::*...)
+{
+    size_t size = 0;
+    size_t align = 1;
+    ((size = (size + alignof(T) - 1) / alignof(T) * alignof(T) + sizeof(T), align = std::max(align, alignof(T))), ...);
+    return { (size + align - 1) / align * align, (sizeof(T) + ...) };
+}
+
+TEST(Layout, sizeof)
+{
+    using kuntest::AAA;
+
+    // members in .proto order, each followed by its cached size or spare, as they used to be declared
+    auto [declared, members] = Sizes(
+      &AAA::i32, &AAA::u32, &AAA::i64, &AAA::u64, &AAA::f, &AAA::d, &AAA::s, &AAA::bt, &AAA::e, &AAA::b, &AAA::s32,
+      &AAA::s64, &AAA::sf32, &AAA::sf64, &AAA::f32, &AAA::f64, &AAA::i32s, &AAA::_i32s_cached_size_, &AAA::u32s,
+      &AAA::_u32s_cached_size_, &AAA::i64s, &AAA::_i64s_cached_size_, &AAA::u64s, &AAA::_u64s_cached_size_, &AAA::fs,
+      &AAA::ds, &AAA::ss, &AAA::_ss_spare_, &AAA::bts, &AAA::_bts_spare_, &AAA::es, &AAA::_es_cached_size_, &AAA::bs,
+      &AAA::s32s, &AAA::_s32s_cached_size_, &AAA::s64s, &AAA::_s64s_cached_size_, &AAA::sf32s, &AAA::sf64s,
+      &AAA::f32s, &AAA::f64s, &AAA::kvs, &AAA::kvs2, &AAA::bbb, &AAA::_bbb_spare_, &AAA::bbbs, &AAA::_bbbs_spare_,
+      &AAA::_cached_size_);
+
+    EXPECT_LT(sizeof(AAA), declared);
+    // padding only at the end
+    EXPECT_EQ(sizeof(AAA), (members + alignof(AAA) - 1) / alignof(AAA) * alignof(AAA));
+
+    // the scalars are grouped by alignment behind the 8-byte members
+    EXPECT_LT(offsetof(AAA, f64), offsetof(AAA, i32));
+    EXPECT_LT(offsetof(AAA, bbbs), offsetof(AAA, i32));
+    EXPECT_LT(offsetof(AAA, f32), offsetof(AAA, b));
+
+    // indices and encoding stay in .proto and field number order
+    EXPECT_EQ(AAA::__meta__[0].name, "i32");
+    EXPECT_EQ(AAA::__meta__[9].name, "b");
+}
@@ -0,0 +1,90 @@
+#include <codec.h>
+#include <gtest/gtest.h>
+
+#include "lazy.kun.h"
+
+// lazy.proto is generated without clear=spare
+template <typename T>
+concept HasSpare = requires(T& e) { e._eager_spare_; };
+static_assert(!HasSpare<kunlazy::Envelope>);
+
+kunlazy::Envelope MakeEnvelope()
+{
+    kunlazy::Envelope e;
+    e.id = 1;
+    e.payload.emplace().data = "payload";
+    e.payload->ints = { 1, 2, 3 };
+    e.items.resize(2);
+    e.items[0].emplace().data = "first";
+    e.items[1].emplace().ints = { 4 };
+    e.eager = std::make_unique<kunlazy::Payload>();
+    e.eager->data = "eager";
+    return e;
+}
+
+TEST(Lazy, untouched)
+{
+    kun::Encoder enc;
+    enc.Encode(MakeEnvelope());
+    std::string data = enc.Str();
+
+    kunlazy::Envelope e;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(e));
+    EXPECT_TRUE(e.payload);
+    EXPECT_FALSE(e.payload.Parsed());
+    EXPECT_FALSE(e.items[0].Parsed());
+
+    // written back from the kept bytes
+    kun::Encoder again;
+    again.Encode(e);
+    EXPECT_EQ(again.Str(), data);
+    EXPECT_FALSE(e.payload.Parsed());
+
+    kun::ReverseEncoder reverse;
+    EXPECT_EQ(reverse.Encode(e), data);
+}
+
+TEST(Lazy, access)
+{
+    kun::Encoder enc;
+    enc.Encode(MakeEnvelope());
+    std::string data = enc.Str();
+
+    kunlazy::Envelope e;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(e));
+    EXPECT_EQ(e, MakeEnvelope());
+
+    EXPECT_EQ(e.payload->data, "payload");
+    EXPECT_TRUE(e.payload.Parsed());
+    e.payload->data = "changed";
+    e.items[1]->ints.push_back(5);
+
+    kun::Encoder again;
+    again.Encode(e);
+    kunlazy::Envelope out;
+    kun::Decoder dec2(again.Str());
+    EXPECT_TRUE(dec2.Decode(out));
+    EXPECT_EQ(out.payload->data, "changed");
+    EXPECT_EQ(out.items[1]->ints, (std::vector<int32_t>{ 4, 5 }));
+    EXPECT_EQ(out.items[0]->data, "first");
+}
+
+TEST(Lazy, malformed)
+{
+    kunlazy::Envelope e;
+    e.payload.Assign(reinterpret_cast<const uint8_t*>("\x0a\x05x"), 3);
+
+    kun::Encoder enc;
+    enc.Encode(e);
+
+    // the parent decodes, the field does not
+    kunlazy::Envelope out;
+    kun::Decoder dec(enc.Str());
+    EXPECT_TRUE(dec.Decode(out));
+    EXPECT_FALSE(out.payload.Parse());
+    EXPECT_EQ(out.payload.get(), nullptr);
+    EXPECT_THROW(out.payload->data.size(), std::runtime_error);
+    EXPECT_THROW((void)*std::as_const(out.payload), std::runtime_error);
+}
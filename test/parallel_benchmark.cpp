@@ -0,0 +1,84 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "a.kun.h"
+#include "codec.h"
+#include "test/helper.h"
+
+// Decodes and encodes a message with a large repeated message field sequentially, and with DecodeParallel() and
+// EncodeParallel() on 1 to N threads.
+// usage: parallel_bench <elements> [max threads]
+
+template <typename Fn>
+double Measure(int rounds, Fn&& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / rounds;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        return -1;
+    }
+
+    size_t n = atoi(argv[1]);
+    size_t threads = argc >= 3 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+
+    kuntest::AAA a = GenAAA();
+    a.bbbs.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        GenRandRepeated(a.bbbs[i].ints);
+        a.bbbs[i].value = { "element " + std::to_string(i) };
+    }
+    kun::Encoder enc;
+    enc.Encode(a);
+    std::string data = enc.Str();
+
+    std::cout << "benchmark parallel elements: " << n << " bytes: " << data.size() << std::endl;
+
+    int rounds = std::max<int>(1, 1000000000 / std::max<size_t>(data.size(), 1));
+    bool ok = true;
+    // warm up the allocator
+    Measure(1, [&] {
+        kuntest::AAA out;
+        kun::Decoder dec(data);
+        ok &= dec.Decode(out);
+    });
+    auto sequential = Measure(rounds, [&] {
+        kuntest::AAA out;
+        kun::Decoder dec(data);
+        ok &= dec.Decode(out);
+    });
+    std::cout << "decode sequential: " << sequential << "ms" << std::endl;
+
+    for (size_t t = 1; t <= threads; t++) {
+        kun::ThreadExecutor executor(t);
+        auto parallel = Measure(rounds, [&] {
+            kuntest::AAA out;
+            kun::Decoder dec(data);
+            ok &= dec.DecodeParallel(out, executor);
+        });
+        std::cout << "threads: " << t << "\t" << parallel << "ms (x" << sequential / parallel << ")" << std::endl;
+    }
+
+    kun::Encoder out;
+    sequential = Measure(rounds, [&] { out.Encode(a); });
+    std::cout << "encode sequential: " << sequential << "ms" << std::endl;
+
+    for (size_t t = 1; t <= threads; t++) {
+        kun::ThreadExecutor executor(t);
+        auto parallel = Measure(rounds, [&] { out.EncodeParallel(a, executor); });
+        ok &= out.Str() == data;
+        std::cout << "threads: " << t << "\t" << parallel << "ms (x" << sequential / parallel << ")" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+#include <codec.h>
+#include <gtest/gtest.h>
+
+#include "presence.kun.h"
+#include "test/helper.h"
+
+// presence.proto is generated with presence=bits
+
+template <typename T>
+concept HasAccessors = requires(T& s) {
+    s.has_v40();
+    s.set_v40(40);
+};
+
+TEST(Presence, accessors)
+{
+    kunpresence::Sparse s;
+    EXPECT_FALSE(s.has_count());
+    s.set_count(3);
+    EXPECT_TRUE(s.has_count());
+    EXPECT_EQ(s.count, 3);
+    s.clear_count();
+    EXPECT_FALSE(s.has_count());
+    EXPECT_EQ(s.count, 0);
+
+    // implicit presence: no bit, a field assigned directly is written
+    static_assert(!HasAccessors<kunpresence::Sparse>);
+    s.v40 = 40;
+    EXPECT_EQ(Decoded<kunpresence::Sparse>(EncodeChecked(s)).v40, 40);
+}
+
+TEST(Presence, encode)
+{
+    kunpresence::Sparse s;
+    EXPECT_TRUE(EncodeChecked(s).empty());
+
+    // implicit presence: zero is not written
+    s.id = 0;
+    s.enabled = false;
+    EXPECT_TRUE(EncodeChecked(s).empty());
+
+    // explicit presence: a set zero is
+    s.set_count(0);
+    s.set_label("");
+    s.set_ratio(0.0);
+    s.set_tail(0);
+    auto d = Decoded<kunpresence::Sparse>(EncodeChecked(s));
+    EXPECT_TRUE(d.has_count());
+    EXPECT_TRUE(d.has_label());
+    EXPECT_TRUE(d.has_ratio());
+    EXPECT_TRUE(d.has_tail());
+}
+
+TEST(Presence, decode)
+{
+    kunpresence::Sparse s;
+    s.id = 7;
+    s.set_label("label");
+    s.set_count(2);
+    s.v9 = 9;
+    s.v64 = 64;
+    s.v65 = 65;
+    s.set_tail(66);
+    s.codes = { 1, 2, 3 };
+    s.item = std::make_unique<kunpresence::Item>();
+    s.item->name = "item";
+    s.weights = { { -1, -2 } };
+
+    auto d = Decoded<kunpresence::Sparse>(EncodeChecked(s));
+    EXPECT_EQ(d, s);
+    EXPECT_TRUE(d.has_label());
+    EXPECT_TRUE(d.has_count());
+    EXPECT_FALSE(d.has_ratio());
+    // in the second word of bits
+    EXPECT_TRUE(d.has_tail());
+    EXPECT_EQ(EncodeChecked(d), EncodeChecked(s));
+
+    auto copy = d;
+    EXPECT_TRUE(copy.has_tail());
+    d.Clear();
+    EXPECT_FALSE(d.has_label());
+    EXPECT_FALSE(d.has_tail());
+    EXPECT_TRUE(EncodeChecked(d).empty());
+}
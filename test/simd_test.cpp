@@ -0,0 +1,99 @@
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "simd.h"
+
+// Built once with -mavx2 and once with -msse4.1, so both vector paths of simd.h are checked against the scalar
+// loops.
+
+#if !defined(KUN_SIMD_EXPECT_AVX2) && !defined(KUN_SIMD_EXPECT_SSE41)
+#    error "build with -DKUN_SIMD_EXPECT_AVX2 -mavx2 or -DKUN_SIMD_EXPECT_SSE41 -msse4.1"
+#endif
+#if defined(KUN_SIMD_EXPECT_AVX2) && !defined(__AVX2__)
+#    error "the AVX2 kernels are not compiled in"
+#endif
+#if defined(KUN_SIMD_EXPECT_SSE41) && (!defined(__SSE4_1__) || defined(__AVX2__))
+#    error "the SSE4.1 kernels are not compiled in"
+#endif
+
+using kun::simd::VarintMode;
+
+template <VarintMode mode, typename T>
+void Check(const std::vector<T>& data)
+{
+    auto n = data.size();
+    EXPECT_EQ(kun::simd::PackedVarintSize<mode>(data.data(), n),
+              kun::simd::PackedVarintSizeScalar<mode>(data.data(), n));
+
+    std::vector<uint8_t> scalar(n * 10);
+    std::vector<uint8_t> batch(n * 10);
+    auto scalarEnd = kun::simd::EncodePackedVarintScalar<mode>(scalar.data(), data.data(), n);
+    auto batchEnd = kun::simd::EncodePackedVarint<mode>(batch.data(), data.data(), n);
+    scalar.resize(scalarEnd - scalar.data());
+    batch.resize(batchEnd - batch.data());
+    ASSERT_EQ(batch, scalar);
+
+    // every offset, so the vector loops start unaligned and end in every tail length
+    for (size_t i = 0; i < std::min<size_t>(scalar.size(), 64); i++) {
+        EXPECT_EQ(kun::simd::CountVarints(scalar.data() + i, scalar.size() - i),
+                  kun::simd::CountVarintsScalar(scalar.data() + i, scalar.size() - i));
+    }
+    EXPECT_EQ(kun::simd::CountVarints(scalar.data(), scalar.size()), n);
+}
+
+// every length up to a few vector blocks, then a long run
+template <VarintMode mode, typename T, typename Gen>
+void CheckLengths(Gen&& gen)
+{
+    for (size_t n : { 0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 130, 1000 }) {
+        std::vector<T> data(n);
+        for (auto& v : data) {
+            v = gen();
+        }
+        Check<mode>(data);
+    }
+}
+
+template <VarintMode mode, typename T>
+void CheckAll()
+{
+    std::mt19937_64 rng(sizeof(T) * 3 + mode);
+    using Limits = std::numeric_limits<T>;
+
+    // one byte each, the fast path
+    CheckLengths<mode, T>([&] { return static_cast<T>(rng() & 0x3F); });
+
+    // max length: the extremes of the type, which for int32 are sign-extended to ten bytes
+    CheckLengths<mode, T>([&] { return rng() % 2 ? Limits::max() : Limits::min(); });
+
+    // negative values, ten bytes for int32 and int64
+    if constexpr (std::is_signed_v<T>) {
+        CheckLengths<mode, T>([&] { return static_cast<T>(-1 - static_cast<T>(rng() & 0xFFFF)); });
+    }
+
+    // mixed lengths: every width up to the whole type
+    CheckLengths<mode, T>([&] {
+        auto bits = rng() % (sizeof(T) * 8) + 1;
+        auto v = rng();
+        return static_cast<T>(bits >= 64 ? v : v & ((uint64_t(1) << bits) - 1));
+    });
+
+    // blocks of one-byte values broken by a long value, in and out of the scalar runs after it
+    size_t i = 0;
+    CheckLengths<mode, T>([&] { return ++i % 97 == 0 ? Limits::min() : static_cast<T>(i & 0x7F); });
+}
+
+TEST(Simd, int32) { CheckAll<kun::simd::VARINT_SIGN_EXTEND, int32_t>(); }
+
+TEST(Simd, uint32) { CheckAll<kun::simd::VARINT_UNSIGNED, uint32_t>(); }
+
+TEST(Simd, sint32) { CheckAll<kun::simd::VARINT_ZIGZAG, int32_t>(); }
+
+TEST(Simd, int64) { CheckAll<kun::simd::VARINT_UNSIGNED, int64_t>(); }
+
+TEST(Simd, uint64) { CheckAll<kun::simd::VARINT_UNSIGNED, uint64_t>(); }
+
+TEST(Simd, sint64) { CheckAll<kun::simd::VARINT_ZIGZAG, int64_t>(); }
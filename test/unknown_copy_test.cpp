@@ -0,0 +1,106 @@
+#include <array>
+#include <memory_resource>
+#include <string>
+
+#include <codec.h>
+#include <gtest/gtest.h>
+
+#include "unknown.kun.h"
+#include "test/allocations.h"
+#include "test/helper.h"
+
+// unknown.proto is generated with unknown=copy for unknown_copy_test, and with alloc=arena,unknown=copy for
+// unknown_arena_test
+
+// the unknown fields are copies, the decoded buffer can go away
+static_assert(!kun::views_buffer_v<kununknown::Old>);
+
+std::string EncodeNew()
+{
+    kununknown::New n;
+    n.id = 7;
+    n.note = "from a newer schema";
+    auto& item = kun::EmplaceMessage(n.item);
+    item.name = "item";
+    item.size = 1234;
+    for (auto name : { "item 0", "item 1", "item 2" }) {
+        auto& e = n.items.emplace_back();
+        e.name = name;
+        e.size = 1;
+    }
+    n.stamps = { 1, 2, 3 };
+    n.ratio = 0.5;
+    n.flags = 0x80000000;
+
+    kun::Encoder enc;
+    enc.Encode(n);
+    return enc.Str();
+}
+
+std::string Encoded(const kununknown::Old& old)
+{
+    kun::Encoder enc;
+    enc.Encode(old);
+    return enc.Str();
+}
+
+TEST(UnknownCopy, forward)
+{
+    auto expected = EncodeNew();
+
+    kununknown::Old old;
+    {
+        std::string data = EncodeNew();
+        kun::Decoder dec(data);
+        ASSERT_TRUE(dec.Decode(old));
+        EXPECT_FALSE(old._unknown_fields_.empty());
+        EXPECT_FALSE(old.item->_unknown_fields_.empty());
+        EXPECT_EQ(old.ByteSize(), data.size());
+        // overwritten before it goes away
+        data.assign(data.size(), '\0');
+    }
+    EXPECT_EQ(Decoded<kununknown::New>(Encoded(old)), Decoded<kununknown::New>(expected));
+
+    auto copy = old;
+    old.Clear();
+    EXPECT_TRUE(old._unknown_fields_.empty());
+    EXPECT_EQ(Decoded<kununknown::New>(Encoded(copy)), Decoded<kununknown::New>(expected));
+
+    auto moved = std::move(copy);
+    EXPECT_EQ(Decoded<kununknown::New>(Encoded(moved)), Decoded<kununknown::New>(expected));
+}
+
+// alloc=arena: the unknown fields are copied with the allocator of the message, by the decoder and by the
+// allocator-extended copy and move constructors
+template <typename Old>
+void CheckArena()
+{
+    if constexpr (requires { typename Old::allocator_type; }) {
+        auto expected = EncodeNew();
+        std::string data = EncodeNew();
+
+        // the arenas take their blocks from a fixed buffer, nothing may come from the heap
+        std::array<std::byte, 1 << 16> buffer;
+        std::pmr::monotonic_buffer_resource pool(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+        kun::Arena arena(4096, &pool);
+        kun::Arena other(4096, &pool);
+
+        size_t before = allocations;
+        auto previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+        kun::Decoder dec(data);
+        auto old = dec.Decode<Old>(arena);
+        ASSERT_NE(old, nullptr);
+        auto copy = other.Create<Old>(*old);
+        auto moved = arena.Create<Old>(std::move(*copy));
+        std::pmr::set_default_resource(previous);
+        EXPECT_EQ(allocations, before);
+
+        EXPECT_EQ(Decoded<kununknown::New>(Encoded(*old)), Decoded<kununknown::New>(expected));
+        EXPECT_EQ(Decoded<kununknown::New>(Encoded(*moved)), Decoded<kununknown::New>(expected));
+    }
+}
+
+TEST(UnknownCopy, arena)
+{
+    CheckArena<kununknown::Old>();
+}
@@ -0,0 +1,75 @@
+#include <codec.h>
+#include <gtest/gtest.h>
+
+#include "unknown.kun.h"
+#include "test/helper.h"
+
+// unknown.proto is generated with unknown=view
+
+static_assert(kun::views_buffer_v<kununknown::Item>);
+
+kununknown::New MakeNew()
+{
+    kununknown::New n;
+    n.id = 7;
+    n.note = "from a newer schema";
+    n.item = std::make_unique<kununknown::NewItem>();
+    n.item->name = "item";
+    n.item->size = 1234;
+    for (int i = 0; i < 3; i++) {
+        auto& item = n.items.emplace_back();
+        item.name = "item " + std::to_string(i);
+        item.size = i;
+    }
+    n.stamps = { 1, 2, 3 };
+    n.ratio = 0.5;
+    n.flags = 0x80000000;
+    return n;
+}
+
+TEST(Unknown, forward)
+{
+    kun::Encoder enc;
+    enc.Encode(MakeNew());
+    std::string data = enc.Str();
+
+    kununknown::Old old;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.Decode(old));
+    EXPECT_EQ(old.id, 7);
+    EXPECT_EQ(old.item->name, "item");
+    ASSERT_EQ(old.items.size(), 3);
+    EXPECT_EQ(old.items[2].name, "item 2");
+    EXPECT_FALSE(old._unknown_fields_.empty());
+    EXPECT_FALSE(old.item->_unknown_fields_.empty());
+    // nothing is lost, the unknown fields move behind the known ones
+    EXPECT_EQ(old.ByteSize(), data.size());
+
+    kun::Encoder forward;
+    forward.Encode(old);
+    EXPECT_EQ(Decoded<kununknown::New>(forward.Str()), MakeNew());
+
+    kun::ReverseEncoder reverse;
+    EXPECT_EQ(Decoded<kununknown::New>(std::string(reverse.Encode(old))), MakeNew());
+
+    // the ranges point into data
+    auto copy = old;
+    forward.Encode(copy);
+    EXPECT_EQ(Decoded<kununknown::New>(forward.Str()), MakeNew());
+}
+
+TEST(Unknown, clear)
+{
+    kun::Encoder enc;
+    enc.Encode(MakeNew());
+    std::string data = enc.Str();
+
+    kununknown::Old old;
+    kun::Decoder dec(data);
+    EXPECT_TRUE(dec.DecodeReuse(old));
+    EXPECT_GT(old._unknown_fields_.ByteSize(), 0);
+
+    old.Clear();
+    EXPECT_TRUE(old._unknown_fields_.empty());
+    EXPECT_EQ(old.ByteSize(), 0);
+}
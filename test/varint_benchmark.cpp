@@ -0,0 +1,70 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "kun.h"
+
+// Compares the scalar and the batch kernels of simd.h for packed fields of every element width.
+// usage: varint_bench <elements> [max bits]
+
+template <typename Fn>
+double Measure(size_t elements, int rounds, Fn&& fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / (double(elements) * rounds);
+}
+
+template <kun::simd::VarintMode mode, typename T>
+void Run(const std::string& name, size_t n, int bits)
+{
+    std::mt19937_64 rng(n);
+    std::vector<T> data(n);
+    for (auto& v : data) {
+        uint64_t r = rng();
+        v = static_cast<T>(bits >= 64 ? r : r & ((uint64_t(1) << bits) - 1));
+    }
+    std::vector<uint8_t> out(n * 10);
+
+    int rounds = std::max<int>(1, 100000000 / std::max<size_t>(n, 1));
+    size_t sink = 0;
+
+    auto sizeScalar = Measure(n, rounds, [&] { sink += kun::simd::PackedVarintSizeScalar<mode>(data.data(), n); });
+    auto sizeBatch = Measure(n, rounds, [&] { sink += kun::simd::PackedVarintSize<mode>(data.data(), n); });
+    auto encodeScalar = Measure(n, rounds, [&] {
+        sink += kun::simd::EncodePackedVarintScalar<mode>(out.data(), data.data(), n) - out.data();
+    });
+    auto encodeBatch =
+      Measure(n, rounds, [&] { sink += kun::simd::EncodePackedVarint<mode>(out.data(), data.data(), n) - out.data(); });
+
+    std::cout << name << "\tsize: " << sizeScalar << " -> " << sizeBatch << " ns/elem (x" << sizeScalar / sizeBatch
+              << ")\tencode: " << encodeScalar << " -> " << encodeBatch << " ns/elem (x"
+              << encodeScalar / encodeBatch << ")" << (sink == 0 ? " " : "") << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        return -1;
+    }
+
+    size_t n = atoi(argv[1]);
+    int bits = argc >= 3 ? atoi(argv[2]) : 7;
+
+    std::cout << "benchmark varint n: " << n << " bits: " << bits << std::endl;
+
+    Run<kun::simd::VARINT_SIGN_EXTEND, int32_t>("int32 ", n, std::min(bits, 32));
+    Run<kun::simd::VARINT_UNSIGNED, uint32_t>("uint32", n, std::min(bits, 32));
+    Run<kun::simd::VARINT_ZIGZAG, int32_t>("sint32", n, std::min(bits, 32));
+    Run<kun::simd::VARINT_UNSIGNED, int64_t>("int64 ", n, bits);
+    Run<kun::simd::VARINT_UNSIGNED, uint64_t>("uint64", n, bits);
+    Run<kun::simd::VARINT_ZIGZAG, int64_t>("sint64", n, bits);
+
+    return 0;
+}